@@ -0,0 +1,242 @@
+#include "argparser.hpp"
+#include "ast.hpp"
+#include "emitter.hpp"
+#include "generator.hpp"
+#include "lexer.hpp"
+#include "mappedfile.hpp"
+#include "utils.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Source {
+	std::string path;
+	std::string_view src;
+};
+
+struct Timings {
+	double lex = 0.0;
+	double parse = 0.0;
+	double emit = 0.0;
+	size_t bytesRead = 0;
+	size_t tokens = 0;
+	size_t nodes = 0;
+	size_t bytesEmitted = 0;
+};
+
+double since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double peakRssMegabytes() {
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	// Reported in kilobytes on Linux
+	return usage.ru_maxrss / 1024.0;
+}
+
+// Every file reachable from the inputs through 'requires', each once.
+// Generated files are looked up in the spec before going to disk
+std::vector<Source> discover(const std::vector<std::string>& inputs, const Spec& spec, std::list<MappedFile>& mapped) {
+	std::vector<Source> sources;
+	std::set<std::string> seen;
+	std::vector<std::string> queue(inputs.rbegin(), inputs.rend());
+
+	while(!queue.empty()) {
+		auto path = std::move(queue.back());
+		queue.pop_back();
+		if(!seen.insert(path).second) {
+			continue;
+		}
+
+		std::string_view src;
+		auto it = std::find_if(spec.begin(), spec.end(), [&](const auto& file) {
+			return file.first == path;
+		});
+		if(it != spec.end()) {
+			src = it->second;
+		} else {
+			mapped.emplace_back();
+			mapped.back().open(path.c_str());
+			dieIfError();
+			src = mapped.back().view();
+		}
+		registerSource(src);
+
+		Lexer lexer(src);
+		const auto tokens = lexer();
+		dieIfError();
+		std::vector<PendingRequire> requires;
+		Parser parser(tokens, src, path, &requires);
+		parser();
+		dieIfError();
+
+		for(auto req = requires.rbegin(); req != requires.rend(); ++req) {
+			queue.push_back(std::move(req->path));
+		}
+		sources.push_back({std::move(path), src});
+	}
+
+	return sources;
+}
+
+// Runs each phase over all sources in turn, so that they can be timed apart
+Timings runPhases(const std::vector<Source>& sources, const std::string& output) {
+	Timings timings;
+	std::vector<std::vector<Token>> tokens(sources.size());
+
+	auto start = Clock::now();
+	for(size_t i = 0; i < sources.size(); i++) {
+		Lexer lexer(sources[i].src);
+		tokens[i] = lexer();
+		dieIfError();
+		timings.bytesRead += sources[i].src.size();
+		timings.tokens += tokens[i].size();
+	}
+	timings.lex = since(start);
+
+	start = Clock::now();
+	RootAstNode::Ptr root;
+	std::vector<PendingRequire> requires;
+	for(size_t i = 0; i < sources.size(); i++) {
+		Parser parser(tokens[i], sources[i].src, sources[i].path, &requires);
+		auto other = parser();
+		dieIfError();
+		if(root) {
+			root->join(other);
+		} else {
+			root = std::move(other);
+		}
+		requires.clear();
+	}
+	timings.parse = since(start);
+	timings.nodes = root->nodes;
+
+	// A file left from an earlier run would make the writer compare rather
+	// than write
+	std::filesystem::remove(output);
+	const std::string stamp = "// scv_bench";
+	const std::string source;
+	start = Clock::now();
+	Emitter emitter(*root, output, source, stamp);
+	emitter();
+	dieIfError();
+	timings.emit = since(start);
+	timings.bytesEmitted = emitter.bytesWritten();
+
+	return timings;
+}
+
+void report(const Timings& t, size_t files) {
+	std::cout << "input: " << files << " files, " << t.bytesRead / 1e6 << " MB\n";
+	std::cout << "lex:   " << t.lex * 1e3 << " ms, " << t.tokens << " tokens, "
+		<< t.tokens / t.lex / 1e6 << " Mtokens/s, "
+		<< t.bytesRead / t.lex / 1e6 << " MB/s\n";
+	std::cout << "parse: " << t.parse * 1e3 << " ms, " << t.nodes << " nodes, "
+		<< t.nodes / t.parse / 1e6 << " Mnodes/s\n";
+	std::cout << "emit:  " << t.emit * 1e3 << " ms, " << t.bytesEmitted << " bytes, "
+		<< t.bytesEmitted / t.emit / 1e6 << " MB/s\n";
+	std::cout << "peak rss: " << peakRssMegabytes() << " MB\n";
+}
+
+// Emission should take the same time per struct regardless of count
+void benchScaling(GeneratorOptions options, const std::string& output) {
+	const size_t structs = options.structs;
+	for(size_t n = structs; n <= structs * 8; n *= 2) {
+		options.structs = n;
+		const auto spec = generateSpec(options);
+		std::list<MappedFile> mapped;
+		const auto sources = discover({spec.front().first}, spec, mapped);
+		const auto timings = runPhases(sources, output);
+		std::cout << "emit: " << n << " structs in " << timings.emit * 1e3 << " ms, "
+			<< timings.emit / n * 1e6 << " us/struct\n";
+	}
+}
+
+}
+
+int main(int argc, char** argv) {
+	int structs = 2000;
+	int members = 8;
+	int traits = 2;
+	int chain = 4;
+	int files = 8;
+	int codeLines = 4;
+	int repeat = 5;
+	bool scaling = false;
+	std::string generateDir;
+
+	ArgParser argParser(argc, argv);
+	argParser.addInt(&structs, "--structs");
+	argParser.addInt(&members, "--members");
+	argParser.addInt(&traits, "--traits");
+	argParser.addInt(&chain, "--chain");
+	argParser.addInt(&files, "--files");
+	argParser.addInt(&codeLines, "--code-lines");
+	argParser.addInt(&repeat, "--repeat");
+	argParser.addBool(&scaling, "--scaling");
+	argParser.addString(&generateDir, "--generate");
+	auto inputs = argParser.unwind();
+
+	GeneratorOptions options;
+	options.structs = static_cast<size_t>(std::max(structs, 1));
+	options.members = static_cast<size_t>(std::max(members, 0));
+	options.traits = static_cast<size_t>(std::max(traits, 0));
+	options.chain = static_cast<size_t>(std::max(chain, 1));
+	options.files = static_cast<size_t>(std::max(files, 1));
+	options.codeLines = static_cast<size_t>(std::max(codeLines, 0));
+
+	const std::string output = (std::filesystem::temp_directory_path() / "scv_bench.hpp").string();
+
+	if(scaling) {
+		benchScaling(options, output);
+		return EXIT_SUCCESS;
+	}
+
+	Spec spec;
+	std::vector<std::string> entries(inputs.begin(), inputs.end());
+	if(entries.empty()) {
+		spec = generateSpec(options);
+		if(!generateDir.empty()) {
+			if(!writeSpec(spec, generateDir)) {
+				std::cerr << "Could not write spec to: " << generateDir << '\n';
+				return EXIT_FAILURE;
+			}
+			std::cout << "Wrote " << spec.size() << " files to " << generateDir << '\n';
+			return EXIT_SUCCESS;
+		}
+		entries.push_back(spec.front().first);
+	}
+
+	std::list<MappedFile> mapped;
+	const auto sources = discover(entries, spec, mapped);
+
+	// Best of each phase over the runs
+	Timings best;
+	for(int i = 0; i < std::max(repeat, 1); i++) {
+		const auto timings = runPhases(sources, output);
+		if(i == 0) {
+			best = timings;
+			continue;
+		}
+		best.lex = std::min(best.lex, timings.lex);
+		best.parse = std::min(best.parse, timings.parse);
+		best.emit = std::min(best.emit, timings.emit);
+	}
+
+	report(best, sources.size());
+	std::filesystem::remove(output);
+	return EXIT_SUCCESS;
+}
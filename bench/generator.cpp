@@ -0,0 +1,88 @@
+#include "generator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string_view>
+
+namespace {
+
+constexpr std::array<std::string_view, 8> primitives = {
+	"int", "string", "u64", "float", "bool", "i16", "double", "u8",
+};
+
+// The first trait streams a struct, which the others and nested members
+// print through. Filler lines hold numbers, suffixes included, so that the
+// bench covers lexing them
+void appendTrait(std::string& src, size_t index, size_t codeLines) {
+	const auto n = std::to_string(index);
+	src.append("trait Trait" + n + " requires <iostream> {\ncode {\n");
+	if(index == 0) {
+		src.append("std::ostream& operator<<(std::ostream& os, const @Type& value) {\n");
+	} else {
+		src.append("std::ostream& print" + n + "(std::ostream& os, const @Type& value) {\n");
+	}
+	for(size_t i = 0; i < codeLines; i++) {
+		src.append("\tos << \"generated filler for @Type: \" << " + std::to_string(i) + " * 0x1fu + 10ull << '\\n';\n");
+	}
+	src.append("\t@ForMemberIn(@Type) code {\n\t\tos << value.@Member << ' ';\n\t}\n");
+	src.append("\treturn os;\n}\n}\n}\n\n");
+}
+
+void appendStruct(std::string& src, size_t index, const GeneratorOptions& options) {
+	src.append("// Generated struct " + std::to_string(index) + "\n");
+	src.append("struct S" + std::to_string(index));
+	for(size_t i = 0; i < options.traits; i++) {
+		src.append(i == 0 ? " is Trait" : ", Trait");
+		src.append(std::to_string(i));
+	}
+	src.append(" {\n");
+	for(size_t i = 0; i < options.members; i++) {
+		src.append("\t");
+		src.append(primitives[i % primitives.size()]);
+		src.append(" m" + std::to_string(i) + "\n");
+	}
+	if(options.chain > 1 && index % options.chain != 0) {
+		src.append("\tS" + std::to_string(index - 1) + " prev\n");
+	}
+	src.append("}\n\n");
+}
+
+}
+
+Spec generateSpec(const GeneratorOptions& options) {
+	const size_t files = std::max<size_t>(options.files, 1);
+	Spec spec;
+	spec.emplace_back("main.scv", "");
+	spec.emplace_back("traits.scv", "");
+
+	for(size_t i = 0; i < options.traits; i++) {
+		appendTrait(spec[1].second, i, options.codeLines);
+	}
+
+	spec[0].second.append("requires traits\n");
+	for(size_t i = 0; i < files; i++) {
+		const auto name = "part" + std::to_string(i);
+		spec[0].second.append("requires " + name + "\n");
+		spec.emplace_back(name + ".scv", "requires traits\n\n");
+	}
+
+	for(size_t i = 0; i < options.structs; i++) {
+		appendStruct(spec[2 + i * files / options.structs].second, i, options);
+	}
+
+	return spec;
+}
+
+bool writeSpec(const Spec& spec, const std::filesystem::path& dir) {
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	for(const auto& [path, src] : spec) {
+		std::ofstream file(dir / path, std::ios::binary);
+		file << src;
+		if(!file) {
+			return false;
+		}
+	}
+	return !ec;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct GeneratorOptions {
+	size_t structs = 2000;
+	// Primitive members per struct, on top of the nested struct member
+	size_t members = 8;
+	size_t traits = 2;
+	// Number of structs in each chain of structs holding the one before it
+	size_t chain = 4;
+	// Number of files the structs are spread over, all required by the entry
+	size_t files = 8;
+	// Plain lines of code in each trait around its member loop
+	size_t codeLines = 4;
+};
+
+// Generated files as (path, contents), the entry point first
+using Spec = std::vector<std::pair<std::string, std::string>>;
+
+Spec generateSpec(const GeneratorOptions& options);
+bool writeSpec(const Spec& spec, const std::filesystem::path& dir);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Contiguous run of elements owned by an arena
+template<typename T>
+class Span {
+public:
+	Span() = default;
+	Span(T* first, size_t count) : first(first), count(count) {}
+	template<size_t N>
+	Span(T (&array)[N]) : first(array), count(N) {}
+
+	T* begin() const { return first; }
+	T* end() const { return first + count; }
+	T& operator[](size_t i) const { return first[i]; }
+	T& front() const { return first[0]; }
+	T& back() const { return first[count - 1]; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+private:
+	T* first = nullptr;
+	size_t count = 0;
+};
+
+// Bump allocator handing out memory from large blocks which are only ever
+// released all at once. Destructors are never run, so only trivially
+// destructible objects may be placed in it
+class Arena {
+public:
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena(Arena&&) = default;
+	Arena& operator=(Arena&&) = default;
+
+	void* allocate(size_t size, size_t alignment);
+
+	template<typename T, typename... Args>
+	T* make(Args&&... args) {
+		static_assert(std::is_trivially_destructible_v<T>, "Arena never runs destructors");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	Span<T> copy(const T* first, size_t count) {
+		static_assert(std::is_trivially_copyable_v<T>, "Arena copies are bytewise");
+		if(count == 0) {
+			return {};
+		}
+		auto ptr = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		std::uninitialized_copy(first, first + count, ptr);
+		return Span<T>(ptr, count);
+	}
+
+	std::string_view copy(std::string_view sv);
+
+	// Takes over every block of the other arena
+	void absorb(Arena& other);
+
+	size_t bytesReserved() const;
+private:
+	static constexpr size_t blockSize = 64 * 1024;
+
+	std::vector<std::unique_ptr<std::byte[]>> blocks;
+	std::byte* cursor = nullptr;
+	size_t remaining = 0;
+	size_t reserved = 0;
+};
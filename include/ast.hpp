@@ -1,51 +1,67 @@
 #pragma once
 
+#include "arena.hpp"
 #include "token.hpp"
 
+#include <array>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 class AstVisitor;
 
+// Nodes live in the arena of the root they were parsed into and refer to
+// names by views into the source, which outlives them
 struct AstNode {
 	AstNode(const Token* token);
-	using Ptr = std::unique_ptr<AstNode>;
+	using Ptr = AstNode*;
+	using Children = Span<Ptr>;
 
-	virtual ~AstNode() = default;
 	virtual void accept(AstVisitor& visitor) = 0;
-	void addChild(Ptr child);
-	std::vector<Ptr> children;
 	const Token* origin;
 };
 
 struct StructAstNode : public AstNode {
 	StructAstNode(const Token* token);
 	void accept(AstVisitor& visitor) final;
-	std::string name;
+	std::string_view name;
 
-	std::vector<std::string> traits;
+	Span<std::string_view> options;
+	Span<std::string_view> traits;
+	Children children;
 };
 
 struct MemberAstNode : public AstNode {
 	MemberAstNode(const Token* type, const Token* name);
 	void accept(AstVisitor& visitor) final;
-	std::string type;
-	std::string name;
+	std::string_view type;
+	std::string_view name;
 	const Token* nameToken;
+	Span<std::string_view> options;
+	// Given as type<capacity>, zero otherwise
+	uint32_t capacity = 0;
+	// Arrays are given as type name[count], sequences as [type] name
+	uint32_t count = 0;
+	// Given as name = tag, zero otherwise
+	uint32_t tag = 0;
+	bool sequence = false;
 };
 
 struct TraitAstNode : public AstNode {
 	TraitAstNode(const Token* token);
 	void accept(AstVisitor& visitor) final;
-	std::string name;
-	std::vector<std::string> requirements;
+	std::string_view name;
+	Span<std::string_view> options;
+	Span<std::string_view> requirements;
+	Children children;
 };
 
 struct CodeAstNode : public AstNode {
 	CodeAstNode(const Token* token);
 	void accept(AstVisitor& visitor) final;
+	Children children;
 };
 
 // Represents "unimportant" which lacks macros
@@ -55,15 +71,38 @@ struct SegmentAstNode : public AstNode {
 	std::string_view segment;
 };
 
+enum class MacroKind {
+	Type,
+	ForMemberIn,
+	Member,
+	Allocator,
+	IfSequence,
+	IfScalar,
+	N_MacroKinds,
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(MacroKind::N_MacroKinds)> macroNames = {
+	"Type",
+	"ForMemberIn",
+	"Member",
+	"Allocator",
+	"IfSequence",
+	"IfScalar",
+};
+
 // Starts with an @, is optionally followed by a sequence of args
 // e.g: @Macro1, @Macro2(arg1, arg2)
 struct MacroAstNode : public AstNode {
 	MacroAstNode(const Token* token);
 	void accept(AstVisitor& visitor) final;
-	AstNode::Ptr optionalCode;
-	std::string name;
+	AstNode::Ptr optionalCode = nullptr;
+	std::string_view name;
+	MacroKind kind;
+	Children children;
 };
 
+// Owns every node of the files joined into it. Joining splices the other
+// root into this one rather than nesting it
 struct RootAstNode : public AstNode {
 	using Ptr = std::unique_ptr<RootAstNode>;
 
@@ -72,8 +111,12 @@ struct RootAstNode : public AstNode {
 
 	void join(RootAstNode::Ptr& other);
 
+	std::vector<AstNode::Ptr> children;
 	std::vector<StructAstNode*> structs;
 	std::vector<TraitAstNode*> traits;
+	Arena arena;
+	// Number of nodes built into the arena, for statistics
+	size_t nodes = 0;
 };
 
 class AstVisitor {
@@ -88,9 +131,19 @@ public:
 	virtual void visit(const MacroAstNode& node) = 0;
 };
 
+// A 'requires' directive left for the caller to resolve, along with the
+// position in the requiring root at which the required root is to be joined
+struct PendingRequire {
+	std::string path;
+	const Token* token;
+	size_t nStructs;
+	size_t nTraits;
+	size_t nChildren;
+};
+
 class Parser {
 public:
-	Parser(const std::vector<Token>& tokens, const std::string& src, const std::string_view originFile);
+	Parser(const std::vector<Token>& tokens, std::string_view src, const std::string_view originFile, std::vector<PendingRequire>* deferredRequires = nullptr);
 	RootAstNode::Ptr operator()();
 private:
 	AstNode::Ptr buildStruct();
@@ -100,17 +153,34 @@ private:
 	AstNode::Ptr buildSegment(size_t &currentDepth);
 	AstNode::Ptr buildMacro();
 	bool buildRequire(RootAstNode::Ptr& root);
-	std::vector<AstNode::Ptr> buildMacroArgList();
-
-	std::vector<std::string> buildRequirements();
+	AstNode::Children buildMacroArgList();
+	bool buildNameList(Span<std::string_view>& names, const char* expected);
+	bool buildNumber(uint32_t& value, const char* expected);
+	AstNode::Children collectNodes(size_t mark);
+	Span<std::string_view> collectNames(size_t mark);
+	template<typename T, typename... Args>
+	T* make(Args&&... args) {
+		++*nodes;
+		return arena->make<T>(std::forward<Args>(args)...);
+	}
+
+	Span<std::string_view> buildRequirements();
 	std::string joinTokenValuesUntilToken(TokenType delim);
 	const Token* getIf(TokenType type);
 	const Token* getIfNot(TokenType type);
+	const Token& currentToken() const;
 	bool eof() const;
 
 	const std::vector<Token>& tokens;
-	const std::string& src;
+	const std::string_view src;
 	const std::string_view originFile;
+	std::vector<PendingRequire>* deferredRequires;
+	// Children and names of the nodes being built are gathered here and
+	// copied into the arena once complete
+	std::vector<AstNode::Ptr> nodeStack;
+	std::vector<std::string_view> nameStack;
+	Arena* arena;
+	size_t* nodes;
 	size_t current;
 	size_t last;
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "symbols.hpp"
+#include "writer.hpp"
+
+#include <string_view>
+#include <vector>
+
+// A trait generated by scv itself rather than expanded from a spec. Used by
+// structs naming a trait that no spec defines
+class Builtin {
+public:
+	virtual ~Builtin() = default;
+
+	virtual std::string_view name() const = 0;
+	virtual Span<const std::string_view> requirements() const = 0;
+	// Fails when the trait cannot be generated for a struct, by default when
+	// a member is a struct which does not implement the trait itself
+	virtual bool check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const;
+	// Written once before any struct, for helpers shared between structs
+	virtual void writePrelude(OutputWriter& output) const;
+	// Whether the trait calls the varint helpers of scv::varint, which are
+	// written once for every builtin using them
+	virtual bool usesVarints() const;
+	virtual void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const = 0;
+	virtual size_t estimateSize(const SymbolTable::Struct& struc) const = 0;
+};
+
+const Builtin* findBuiltin(std::string_view name);
+
+void writeVarintPrelude(OutputWriter& output);
+
+// Each builtin lives in a translation unit of its own
+const Builtin& binaryBuiltin();
+const Builtin& soaBuiltin();
+const Builtin& viewBuiltin();
+const Builtin& batchBuiltin();
+const Builtin& hashableBuiltin();
+const Builtin& jsonBuiltin();
+const Builtin& csvBuiltin();
+const Builtin& taggedBuiltin();
+
+// Consecutive fixed width members which lie next to each other in memory
+// without padding in between, and are written out as they are in memory, so
+// that they can be copied as one block.
+// Any other member is a run of its own, of no bytes. Runs are positions in
+// the layout of the struct
+struct MemberRun {
+	size_t first;
+	size_t count;
+	uint32_t bytes;
+};
+
+// Whether a fixed width member may join a run, by default when it is
+// written out as it is in memory
+using RunFilter = bool (*)(const SymbolTable& symbols, const SymbolTable::Member& member);
+
+bool writtenAsIs(const SymbolTable& symbols, const SymbolTable::Member& member);
+
+std::vector<MemberRun> memberRuns(const SymbolTable& symbols, const SymbolTable::Struct& struc, RunFilter joins = writtenAsIs);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A manifest records which files went into producing the outputs, and the
+// outputs themselves, along with their contents hashes, letting a later run
+// with the same configuration skip regeneration entirely when none of them
+// changed or went missing
+namespace cache {
+
+using Sources = std::map<std::string, std::string_view, std::less<>>;
+
+bool upToDate(const std::string& manifest, const std::string& key);
+
+bool store(const std::string& manifest, const std::string& key, const std::vector<std::string>& outputs, const Sources& sources);
+
+std::string hashSources(const std::string& key, const Sources& sources);
+
+}
@@ -12,6 +12,8 @@ void onToken(const std::string& str, const Token& tok);
 
 const std::string& get();
 
+void clear();
+
 bool empty();
 
 }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ast.hpp"
+#include "symbols.hpp"
+#include "writer.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A trait compiled once into a flat list of instructions, which is then run
+// for every struct implementing the trait. Literal text is kept as views
+// into the source and appended straight to the output
+class Expansion {
+public:
+	bool compile(const TraitAstNode& trait);
+	// Returns the number of macros expanded. Functions are only declared in
+	// the output when given a source to define them in, unless inlined
+	size_t run(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output, OutputWriter* source = nullptr, bool inlined = false) const;
+	// Writes the trait once, every declaration a template over the structs
+	// implementing it which loops over their field descriptors
+	size_t runTemplate(const SymbolTable& symbols, std::string_view trait, OutputWriter& output) const;
+	size_t estimateSize(const SymbolTable::Struct& struc) const;
+
+	static constexpr size_t maxLoopDepth = 8;
+
+	enum class Op : uint8_t {
+		Literal,
+		// Start of a top level code block of the trait, with a jump of 1 when
+		// the block defines a function
+		DeclarationBegin,
+		// Start of the body of that function
+		BodyBegin,
+		TypeName,
+		MemberName,
+		AllocatorName,
+		LoopBegin,
+		LoopEnd,
+		// Blocks only expanded for members which are, or are not, arrays or
+		// sequences
+		IfSequence,
+		IfScalar,
+		IfEnd,
+	};
+
+	struct Instruction {
+		Op op;
+		// Index of the matching LoopBegin, LoopEnd or IfEnd, or whether a
+		// DeclarationBegin starts a function
+		uint32_t jump;
+		// Literal text, or the object a member is accessed on
+		std::string_view text;
+	};
+private:
+	friend class ExpansionCompiler;
+
+	std::vector<Instruction> program;
+	size_t fixedSize = 0;
+	size_t perMemberSize = 0;
+};
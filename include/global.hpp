@@ -1,12 +1,29 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace global {
 
+// Part of the --cache key, so it must be bumped whenever the output for the
+// same specs and flags changes, or old manifests keep stale outputs
+constexpr std::string_view version = "0.3.0";
+
 extern std::string outputPath;
 extern bool verboseAllFlag;
 extern bool verboseTokenizationFlag;
 extern bool verboseAstFlag;
+extern int jobs;
+extern std::string cachePath;
+extern bool reproducibleFlag;
+extern bool compactFlag;
+extern bool pmrFlag;
+extern bool reflectFlag;
+extern bool splitFlag;
+extern bool statsFlag;
+extern std::string statsJsonPath;
+
+// Describes every setting that affects generated output
+std::string fingerprint();
 
 }
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Incremental 64-bit FNV-1a, used to fingerprint inputs and outputs
+class Hasher {
+public:
+	void update(std::string_view sv);
+	void update(uint64_t value);
+	uint64_t digest() const;
+	std::string hex() const;
+private:
+	uint64_t state = 0xcbf29ce484222325;
+};
+
+std::string toHex(uint64_t value);
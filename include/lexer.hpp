@@ -5,20 +5,15 @@
 
 class Lexer {
 public:
-	Lexer(const std::string& src);
+	Lexer(std::string_view src);
 	std::vector<Token> operator()();
 private:
-	void lexIdentifierOrKeyword(Token& token, std::vector<Token>& tokens);
-	void ignoreWhitespace();
+	size_t estimateTokens() const;
+	void lexIdentifierOrKeyword(std::vector<Token>& tokens);
+	void lexNumber(std::vector<Token>& tokens);
 	void errorOnCurrent();
 	char peek();
-	void next();
-	void jump(size_t n);
 
-	const std::string& src;
+	const std::string_view src;
 	size_t current = 0;
-	uint32_t column = 0;
-	uint32_t row = 0;
-	uint32_t codeDepth = 0;
-
 };
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Read only contents of a file, memory mapped where the platform allows so
+// that views into it need no copy of the file. Falls back to reading the
+// file into memory elsewhere
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	bool open(const char* path);
+	std::string_view view() const;
+private:
+	void release();
+
+	const char* data = nullptr;
+	size_t size = 0;
+	std::string fallback;
+};
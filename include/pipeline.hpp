@@ -1,11 +1,15 @@
 #pragma once
 #include "ast.hpp"
+#include "cache.hpp"
+#include "mappedfile.hpp"
 #include "token.hpp"
 
 #include <list>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 class Pipeline {
@@ -19,9 +23,30 @@ public:
 
 	static bool hasProcessed(const std::string_view sv);
 
-	static RootAstNode::Ptr buildRootFromSrc(const std::string &src, const std::string_view origin);
-	const static std::string& readFile(const std::string_view sv);
+	static RootAstNode::Ptr buildRootFromSrc(std::string_view src, const std::string_view origin);
+	static std::string_view readFile(const std::string_view sv);
 private:
-	static std::set<std::string_view> previouslyProcessed;
-	static std::list<std::string> storedSrcs;
+	// Result of reading, lexing and parsing a single file on a worker,
+	// requires are left unresolved until the units are merged
+	struct Unit {
+		std::vector<Token> tokens;
+		std::vector<PendingRequire> requires;
+		RootAstNode::Ptr root;
+		std::string error;
+	};
+	using Units = std::unordered_map<std::string, std::unique_ptr<Unit>>;
+
+	static RootAstNode::Ptr serialFrontEnd(const std::vector<std::string_view>& inputs, std::string_view& outputFile);
+	static RootAstNode::Ptr parallelFrontEnd(const std::vector<std::string_view>& inputs, std::string_view& outputFile);
+	static void buildUnit(Unit& unit, const std::string& path);
+	static RootAstNode::Ptr mergeUnit(Unit& unit, Units& units);
+	static std::string configurationKey(const std::vector<std::string_view>& inputs);
+	static std::string_view storeSrc(const std::string_view path, MappedFile&& src);
+	static void storeTokens(std::vector<Token>&& tokens);
+
+	static std::set<std::string, std::less<>> previouslyProcessed;
+	static std::list<MappedFile> storedSrcs;
+	static cache::Sources sources;
+	static std::list<std::vector<Token>> storedTokens;
+	static std::mutex storageMutex;
 };
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// Where the time of a run goes, collected only when asked for with --stats
+// or --stats-json
+namespace stats {
+
+enum class Phase {
+	Cache,
+	Read,
+	Lex,
+	Parse,
+	Requires,
+	Symbols,
+	Compile,
+	Types,
+	Traits,
+	Commit,
+	N_Phases,
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(Phase::N_Phases)> phaseNames = {
+	"cache",
+	"read",
+	"lex",
+	"parse",
+	"requires",
+	"symbols",
+	"compile",
+	"types",
+	"traits",
+	"commit",
+};
+
+enum class Counter {
+	Files,
+	Tokens,
+	Nodes,
+	Structs,
+	Traits,
+	Expansions,
+	Allocations,
+	AllocatedBytes,
+	N_Counters,
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(Counter::N_Counters)> counterNames = {
+	"files",
+	"tokens",
+	"nodes",
+	"structs",
+	"traits",
+	"expansions",
+	"allocations",
+	"allocatedBytes",
+};
+
+void enable();
+bool enabled();
+
+void add(Counter counter, size_t n);
+void addOutput(const std::string& path, size_t bytes, bool changed);
+
+// Adds the time it is alive to a phase, less the time of timers started
+// while it is the innermost one on its thread. Phases run on several
+// threads add up the time of each
+class Timer {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit Timer(Phase phase);
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+	~Timer();
+private:
+	Phase phase;
+	Timer* parent;
+	Clock::time_point start;
+};
+
+void print(std::ostream& os);
+bool writeJson(const std::string& path);
+
+}
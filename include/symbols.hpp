@@ -0,0 +1,138 @@
+#pragma once
+
+#include "arena.hpp"
+#include "ast.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Builtin;
+
+// Every type, struct and trait of a root resolved to an index once, along
+// with the dependencies between structs and the order they are to be
+// written in. Later passes work on indices and never search by name
+class SymbolTable {
+public:
+	using Id = uint32_t;
+	static constexpr Id none = ~Id(0);
+
+	enum class Kind : uint8_t {
+		Signed,
+		Unsigned,
+		Float,
+		Bool,
+		String,
+		InlineString,
+		Array,
+		Sequence,
+		Struct,
+	};
+
+	// Size and alignment are only known for fixed width kinds, which are
+	// laid out in memory the same way on every supported platform. Inline
+	// strings hold their length in a byte followed by their capacity in bytes.
+	// Arrays are fixed width when their elements are
+	struct Type {
+		std::string_view name;
+		std::string_view spelling;
+		Id structId;
+		Kind kind;
+		uint32_t size;
+		// Element type and count of arrays, element type of sequences
+		Id element = none;
+		uint32_t count = 0;
+
+		bool fixedWidth() const;
+	};
+
+	// How integers are encoded by the traits writing them out
+	enum class Encoding : uint8_t {
+		Fixed,
+		Varint,
+		Zigzag,
+	};
+
+	struct Member {
+		const MemberAstNode* node;
+		Id type;
+		Encoding encoding;
+	};
+
+	// Members are listed in declaration order, which is the order traits
+	// see them in, while the layout lists them in the order they lie in
+	// memory. Compact structs have their members ordered by alignment.
+	// Allocator aware structs hold strings or other allocator aware structs,
+	// and take an allocator which they pass on to them. Structs caching their
+	// hash hold it in a field of their own after their members
+	struct Struct {
+		const StructAstNode* node;
+		Id type;
+		Span<const Member> members;
+		Span<const Id> dependencies;
+		Span<const Id> traits;
+		Span<const uint32_t> layout;
+		uint32_t alignment;
+		bool compact;
+		bool varint;
+		bool allocatorAware;
+		bool cachedHash;
+	};
+
+	// Traits are either defined in a spec or built into scv, in which case
+	// they have no node. Inlined traits keep their functions in the header
+	struct Trait {
+		const TraitAstNode* node;
+		const Builtin* builtin;
+		bool inlined;
+	};
+
+	SymbolTable();
+
+	bool build(const RootAstNode& root);
+
+	Id findType(std::string_view name) const;
+	Id findStruct(std::string_view name) const;
+	Id findTrait(std::string_view name) const;
+	const Member& memberAt(const Struct& struc, size_t position) const;
+	bool implements(Id structId, Id trait) const;
+	// Struct held by members of the type, directly or as elements
+	Id heldStruct(Id type) const;
+	// Whether members of the type take the allocator of their struct
+	bool allocates(Id type) const;
+	uint32_t alignmentOf(Id type) const;
+
+	std::vector<Type> types;
+	std::vector<Struct> structs;
+	std::vector<Trait> traits;
+	// Structs ordered so that each follows every struct it depends on
+	std::vector<Id> order;
+	std::unordered_set<std::string_view> requirements;
+	// Allocator taken by allocator aware structs
+	std::string_view allocator;
+	bool inlineStrings = false;
+private:
+	bool mapTypes(const RootAstNode& root);
+	bool mapMembers();
+	Id mapInlineString(const MemberAstNode* node);
+	Id mapContainer(const MemberAstNode* node, Id element);
+	bool checkTag(const MemberAstNode* node, size_t firstMember) const;
+	bool mapEncoding(const Struct& struc, const MemberAstNode* node, Id type, Encoding& encoding) const;
+	bool mapTraits(const RootAstNode& root);
+	Id addBuiltin(std::string_view name);
+	bool checkBuiltins();
+	bool orderStructs();
+	bool layoutStructs();
+	Id addType(std::string_view name, std::string_view spelling, Id structId, Kind kind, uint32_t size);
+
+	std::unordered_map<std::string_view, Id> typeIds;
+	std::unordered_map<std::string_view, Id> traitIds;
+	std::vector<Member> members;
+	std::vector<Id> dependencies;
+	std::vector<Id> structTraits;
+	std::vector<uint32_t> layouts;
+	// Names and spellings of inline strings, arrays and sequences
+	Arena names;
+};
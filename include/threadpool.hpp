@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of workers consuming a shared FIFO of tasks. Tasks may
+// submit further tasks, wait() returns once the queue is drained and every
+// worker is idle
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+	ThreadPool(size_t nWorkers);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	~ThreadPool();
+
+	void submit(Task task);
+	void wait();
+
+	static size_t defaultSize();
+private:
+	void work();
+
+	std::vector<std::thread> workers;
+	std::queue<Task> tasks;
+	std::mutex mutex;
+	std::condition_variable available;
+	std::condition_variable idle;
+	size_t active = 0;
+	bool stopping = false;
+};
@@ -8,6 +8,7 @@
 enum class TokenType {
 	Identifier,
 	Symbol,
+	Number,
 	Struct,
 	Trait,
 	Code,
@@ -15,6 +16,8 @@ enum class TokenType {
 	RParens,
 	LBrace,
 	RBrace,
+	LBracket,
+	RBracket,
 	Less,
 	Greater,
 	Quote,
@@ -22,20 +25,37 @@ enum class TokenType {
 	Is,
 	At,
 	Requires,
+	Colon,
+	Equals,
 	N_TokenTypes,
 };
 
+// Tokens are views into their source, which is kept alive for the duration
+// of the run. Their position is only recovered when it is needed
 struct Token {
 	std::string_view str() const;
 
-	std::string value;
+	const char* begin;
+	uint32_t length;
 	TokenType type;
-	uint32_t column;
+};
+
+static_assert(sizeof(Token) <= 16);
+
+struct Location {
 	uint32_t row;
-	size_t index;
+	uint32_t column;
 };
 
+Location locate(std::string_view src, size_t index);
+
+// Sources registered here let tokens be located without knowing their source
+void registerSource(std::string_view src);
+
+Location locate(const Token& token);
+
 constexpr std::array<std::string_view, static_cast<size_t>(TokenType::N_TokenTypes)> tokenStrings = {
+	"",
 	"",
 	"",
 	"struct",
@@ -45,6 +65,8 @@ constexpr std::array<std::string_view, static_cast<size_t>(TokenType::N_TokenTyp
 	")",
 	"{",
 	"}",
+	"[",
+	"]",
 	"<",
 	">",
 	"\"",
@@ -52,4 +74,6 @@ constexpr std::array<std::string_view, static_cast<size_t>(TokenType::N_TokenTyp
 	"is",
 	"@",
 	"requires",
+	":",
+	"=",
 };
@@ -3,6 +3,7 @@
 #include "token.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 std::string consume(const char* path);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+
+// Buffers output and hands it on in fixed size chunks while it is being
+// generated. Chunks are first compared against the file already at the
+// path; only once they differ is a temporary file written, which replaces
+// the target when closed. An unchanged file is never touched. Trailing
+// whitespace at the very end of the output is dropped
+class OutputWriter {
+public:
+	OutputWriter() = default;
+	OutputWriter(const OutputWriter&) = delete;
+	~OutputWriter();
+
+	bool open(const std::string& path, size_t sizeHint);
+	bool close();
+
+	void append(std::string_view sv) {
+		buffer.append(sv);
+		if(buffer.size() >= chunkSize) {
+			flush();
+		}
+	}
+
+	void push_back(char c) {
+		buffer.push_back(c);
+	}
+
+	size_t size() const;
+	bool changed() const;
+
+	static constexpr size_t chunkSize = 64 * 1024;
+private:
+	void flush();
+	void commit(const char* data, size_t n);
+	void diverge();
+
+	std::string buffer;
+	std::string scratch;
+	std::string path;
+	std::string tempPath;
+	std::ifstream existing;
+	std::ofstream temp;
+	size_t written = 0;
+	bool identical = false;
+	bool failed = false;
+};
@@ -0,0 +1,54 @@
+#include "arena.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+void* Arena::allocate(size_t size, size_t alignment) {
+	auto padding = -reinterpret_cast<uintptr_t>(cursor) & (alignment - 1);
+	if(cursor != nullptr && padding + size <= remaining) {
+		auto ptr = cursor + padding;
+		cursor += padding + size;
+		remaining -= padding + size;
+		return ptr;
+	}
+
+	// Oversized requests get a block of their own, leaving the current one
+	// in place for later small allocations
+	if(size + alignment > blockSize / 4) {
+		blocks.emplace_back(new std::byte[size + alignment]);
+		reserved += size + alignment;
+		auto ptr = blocks.back().get();
+		return ptr + (-reinterpret_cast<uintptr_t>(ptr) & (alignment - 1));
+	}
+
+	blocks.emplace_back(new std::byte[blockSize]);
+	reserved += blockSize;
+	cursor = blocks.back().get();
+	remaining = blockSize;
+	return allocate(size, alignment);
+}
+
+std::string_view Arena::copy(std::string_view sv) {
+	if(sv.empty()) {
+		return {};
+	}
+	auto ptr = static_cast<char*>(allocate(sv.size(), 1));
+	std::memcpy(ptr, sv.data(), sv.size());
+	return std::string_view(ptr, sv.size());
+}
+
+void Arena::absorb(Arena& other) {
+	blocks.reserve(blocks.size() + other.blocks.size());
+	for(auto& block : other.blocks) {
+		blocks.push_back(std::move(block));
+	}
+	reserved += other.reserved;
+	other.blocks.clear();
+	other.cursor = nullptr;
+	other.remaining = 0;
+	other.reserved = 0;
+}
+
+size_t Arena::bytesReserved() const {
+	return reserved;
+}
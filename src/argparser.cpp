@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <charconv>
 
 ArgParser::ArgParser(int argc, char** argv) : args(argv + 1, argv + argc) {
 }
@@ -14,17 +15,33 @@ void ArgParser::addString(std::string* var, std::string_view flag) {
 	flags.insert({flag, {static_cast<void*>(var), VarPtr::Type::String} });
 }
 
+void ArgParser::addInt(int* var, std::string_view flag) {
+	flags.insert({flag, {static_cast<void*>(var), VarPtr::Type::Int} });
+}
+
 const ArgParser::Args& ArgParser::unwind() {
 	for(auto it = args.begin(); it != args.end(); it++) {
 		auto hashIt = flags.find(*it);
 
+		// Values may also be given as --flag=value
+		std::string_view inlineValue;
+		bool hasInlineValue = false;
 		if(hashIt == flags.end() ) {
+			auto equals = it->find('=');
+			if(it->substr(0, 2) == "--" && equals != std::string_view::npos) {
+				hashIt = flags.find(it->substr(0, equals) );
+				inlineValue = it->substr(equals + 1);
+				hasInlineValue = true;
+			}
+		}
+
+		if(hashIt == flags.end() || (hasInlineValue && hashIt->second.type == VarPtr::Type::Bool) ) {
 			unused.push_back(*it);
 			continue;
 		}
 		auto& var = hashIt->second;
 
-		int availableArgs = std::distance(std::next(it), args.end() );
+		int availableArgs = hasInlineValue ? 1 : std::distance(std::next(it), args.end() );
 		if(availableArgs < 1 && var.type != VarPtr::Type::Bool) {
 			std::cerr << "Too few arguments for argument " << hashIt->first 
 				<< ", expected " << 1 << ", recieved " << availableArgs 
@@ -32,16 +49,26 @@ const ArgParser::Args& ArgParser::unwind() {
 			std::exit(EXIT_FAILURE);
 		}
 
+		auto value = hasInlineValue || var.type == VarPtr::Type::Bool ? inlineValue : *std::next(it);
 		switch(var.type) {
 			case VarPtr::Type::Bool:
 				*static_cast<bool*>(var.ptr) = true;
 				break;
 			case VarPtr::Type::String:
-				static_cast<std::string*>(var.ptr)->assign(*std::next(it) );
+				static_cast<std::string*>(var.ptr)->assign(value);
+				break;
+			case VarPtr::Type::Int: {
+				auto result = std::from_chars(value.data(), value.data() + value.size(), *static_cast<int*>(var.ptr) );
+				if(result.ec != std::errc() || result.ptr != value.data() + value.size() ) {
+					std::cerr << "Expected integer for argument " << hashIt->first 
+						<< ", recieved " << value << '\n';
+					std::exit(EXIT_FAILURE);
+				}
 				break;
+			}
 		}
 
-		if(var.type != VarPtr::Type::Bool) {
+		if(var.type != VarPtr::Type::Bool && !hasInlineValue) {
 			std::advance(it, 1);
 		}
 	}
@@ -2,16 +2,14 @@
 
 #include "error.hpp"
 #include "pipeline.hpp"
+#include "stats.hpp"
 
 #include <algorithm>
+#include <charconv>
 #include <iostream>
 
 AstNode::AstNode(const Token* token) : origin(token) {}
 
-void AstNode::addChild(AstNode::Ptr child) {
-	children.push_back(std::move(child));
-}
-
 RootAstNode::RootAstNode() : AstNode(nullptr) {}
 
 void RootAstNode::accept(AstVisitor& visitor) {
@@ -19,24 +17,27 @@ void RootAstNode::accept(AstVisitor& visitor) {
 }
 
 void RootAstNode::join(RootAstNode::Ptr& other) {
+	children.insert(children.end(), other->children.begin(), other->children.end());
 	structs.insert(structs.end(), other->structs.begin(), other->structs.end());
 	traits.insert(traits.end(), other->traits.begin(), other->traits.end());
-	addChild(std::move(other));
+	arena.absorb(other->arena);
+	nodes += other->nodes;
+	other.reset();
 }
 
-StructAstNode::StructAstNode(const Token* token) : name(token->value), AstNode(token) {}
+StructAstNode::StructAstNode(const Token* token) : name(token->str()), AstNode(token) {}
 
 void StructAstNode::accept(AstVisitor& visitor) {
 	visitor.visit(*this);
 }
 
-MemberAstNode::MemberAstNode(const Token* type, const Token* name) : type(type->value), name(name->value), AstNode(type), nameToken(name) {}
+MemberAstNode::MemberAstNode(const Token* type, const Token* name) : type(type->str()), name(name->str()), AstNode(type), nameToken(name) {}
 
 void MemberAstNode::accept(AstVisitor& visitor) {
 	visitor.visit(*this);
 }
 
-TraitAstNode::TraitAstNode(const Token* token) : name(token->value), AstNode(token) {}
+TraitAstNode::TraitAstNode(const Token* token) : name(token->str()), AstNode(token) {}
 
 void TraitAstNode::accept(AstVisitor& visitor) {
 	visitor.visit(*this);
@@ -60,28 +61,28 @@ void MacroAstNode::accept(AstVisitor& visitor) {
 	visitor.visit(*this);
 }
 
-Parser::Parser(const std::vector<Token>& tokens, const std::string& src, const std::string_view originFile) : tokens(tokens), src(src), originFile(originFile) {}
+Parser::Parser(const std::vector<Token>& tokens, std::string_view src, const std::string_view originFile, std::vector<PendingRequire>* deferredRequires) : tokens(tokens), src(src), originFile(originFile), deferredRequires(deferredRequires) {}
 
 RootAstNode::Ptr Parser::operator()() {
 	auto root = std::make_unique<RootAstNode>();
+	arena = &root->arena;
+	nodes = &root->nodes;
 	current = 0;
 	last = tokens.size();
 
 	while(current < last) {
 		if(auto child = buildStruct(); child) {
-			auto ptr = static_cast<StructAstNode*>(child.get());
-			root->structs.push_back(ptr);
-			root->addChild(std::move(child));
+			root->structs.push_back(static_cast<StructAstNode*>(child));
+			root->children.push_back(child);
 		} else if(auto child = buildTrait(); child) {
-			TraitAstNode* trait = static_cast<TraitAstNode*>(child.get());
-			root->traits.push_back(trait);
-			root->addChild(std::move(child));
+			root->traits.push_back(static_cast<TraitAstNode*>(child));
+			root->children.push_back(child);
 		} else if(buildRequire(root)) {
 			continue;
 		} else {
 			// Let error bubble up
 			if(error::empty()) {
-				error::onToken("Unexpected token", eof() ? tokens.back() : tokens[current]);
+				error::onToken("Unexpected token", currentToken());
 			}
 			return nullptr;
 		}
@@ -97,62 +98,107 @@ AstNode::Ptr Parser::buildStruct() {
 
 	const Token* name = getIf(TokenType::Identifier);
 	if(!name) {
-		error::onToken("Expected identifier", tokens[current]);
+		error::onToken("Expected identifier", currentToken());
 		return nullptr;
 	}
 
-	auto struc = std::make_unique<StructAstNode>(name);
+	auto struc = make<StructAstNode>(name);
 
-	if(getIf(TokenType::Is)) {
-		while(1) {
-			const Token* trait = getIf(TokenType::Identifier);
-			if(!trait) {
-				error::onToken("Expected trait name", tokens[current]);
-				return nullptr;
-			}
-			struc->traits.push_back(trait->value);
+	if(getIf(TokenType::Colon) && !buildNameList(struc->options, "Expected option name")) {
+		return nullptr;
+	}
 
-			if(!getIf(TokenType::Comma)) {
-				break;
-			}
-		}
-		
+	if(getIf(TokenType::Is) && !buildNameList(struc->traits, "Expected trait name")) {
+		return nullptr;
 	}
 	
 	if(!getIf(TokenType::LBrace)) {
-		error::onToken("Expected '{'", tokens[current]);
+		error::onToken("Expected '{'", currentToken());
 		return nullptr;
 	}
 
+	const size_t mark = nodeStack.size();
 	while(!getIf(TokenType::RBrace) ) {
 		auto member = buildMember();
 		if(!member) {
 			// Let error bubble up
 			return nullptr;
 		}
-		struc->addChild(std::move(member));
+		nodeStack.push_back(member);
 		if(current >= last) {
-			error::onToken("Expected '}'", tokens[current]);
+			error::onToken("Expected '}'", currentToken());
+			return nullptr;
 		}
 	}
+	struc->children = collectNodes(mark);
 
 	return struc;
 }
 
 AstNode::Ptr Parser::buildMember() {
+	const bool sequence = getIf(TokenType::LBracket) != nullptr;
 	const Token* type = getIf(TokenType::Identifier);
 	if(type == nullptr) {
-		error::onToken("Expected identifier", tokens[current]);
+		error::onToken("Expected identifier", currentToken());
+		return nullptr;
+	}
+
+	uint32_t capacity = 0;
+	if(getIf(TokenType::Less)) {
+		if(!buildNumber(capacity, "Expected capacity")) {
+			return nullptr;
+		}
+		if(!getIf(TokenType::Greater)) {
+			error::onToken("Expected '>'", currentToken());
+			return nullptr;
+		}
+	}
+
+	if(sequence && !getIf(TokenType::RBracket)) {
+		error::onToken("Expected ']'", currentToken());
 		return nullptr;
 	}
 
 	const Token* name = getIf(TokenType::Identifier);
 	if(name == nullptr) {
-		error::onToken("Expected identifier", tokens[current]);
+		error::onToken("Expected identifier", currentToken());
+		return nullptr;
+	}
+
+	// A bracket followed by anything but a number starts the next member,
+	// which is a sequence
+	uint32_t count = 0;
+	const bool array = current + 1 < last && tokens[current].type == TokenType::LBracket && tokens[current + 1].type == TokenType::Number;
+	if(array) {
+		if(sequence) {
+			error::onToken("Sequences cannot be held in arrays", currentToken());
+			return nullptr;
+		}
+		++current;
+		if(!buildNumber(count, "Expected array size")) {
+			return nullptr;
+		}
+		if(!getIf(TokenType::RBracket)) {
+			error::onToken("Expected ']'", currentToken());
+			return nullptr;
+		}
+	}
+
+	uint32_t tag = 0;
+	if(getIf(TokenType::Equals) && !buildNumber(tag, "Expected tag")) {
+		return nullptr;
+	}
+
+	auto member = make<MemberAstNode>(type, name);
+	member->capacity = capacity;
+	member->count = count;
+	member->tag = tag;
+	member->sequence = sequence;
+	if(getIf(TokenType::Colon) && !buildNameList(member->options, "Expected option name")) {
 		return nullptr;
 	}
 
-	return std::make_unique<MemberAstNode>(type, name);
+	return member;
 }
 
 AstNode::Ptr Parser::buildTrait() {
@@ -162,11 +208,15 @@ AstNode::Ptr Parser::buildTrait() {
 
 	auto name = getIf(TokenType::Identifier);
 	if(name == nullptr) {
-		error::onToken("Expected identifier", tokens[current]);
+		error::onToken("Expected identifier", currentToken());
 		return nullptr;
 	}
 
-	auto trait = std::make_unique<TraitAstNode>(name);
+	auto trait = make<TraitAstNode>(name);
+
+	if(getIf(TokenType::Colon) && !buildNameList(trait->options, "Expected option name")) {
+		return nullptr;
+	}
 
 	if(getIf(TokenType::Requires)) {
 		trait->requirements = buildRequirements();
@@ -176,18 +226,20 @@ AstNode::Ptr Parser::buildTrait() {
 	}
 
 	if(!getIf(TokenType::LBrace)) {
-		error::onToken("Expected '{'", tokens[current]);
+		error::onToken("Expected '{'", currentToken());
 		return nullptr;
 	}
 
+	const size_t mark = nodeStack.size();
 	auto code = buildCodeBlock();
 	while(code) {
-		trait->addChild(std::move(code));
+		nodeStack.push_back(code);
 		code = buildCodeBlock();
 	}
+	trait->children = collectNodes(mark);
 
 	if(!getIf(TokenType::RBrace)) {
-		error::onToken("Expected '}'", eof() ? tokens.back() : tokens[current]);
+		error::onToken("Expected '}'", currentToken());
 		return nullptr;
 	}
 
@@ -201,13 +253,14 @@ AstNode::Ptr Parser::buildCodeBlock() {
 	}
 
 	if(!getIf(TokenType::LBrace)) {
-		error::onToken("Expected '{'", tokens[current]);
+		error::onToken("Expected '{'", currentToken());
 		return nullptr;
 	}
 
-	auto code = std::make_unique<CodeAstNode>(token);
+	auto code = make<CodeAstNode>(token);
 
 	size_t currentDepth = 0;
+	const size_t mark = nodeStack.size();
 
 	while(1) {
 		auto segment = buildSegment(currentDepth);
@@ -217,7 +270,7 @@ AstNode::Ptr Parser::buildCodeBlock() {
 		}
 
 		if(getIf(TokenType::RBrace)) {
-			auto asSegment = static_cast<SegmentAstNode*>(segment.get());
+			auto asSegment = static_cast<SegmentAstNode*>(segment);
 			auto view = asSegment->segment;
 			auto firstNonSpaceOrNewline = [](const char c) {
 				return !std::isspace(c) || c == '\n';
@@ -227,14 +280,15 @@ AstNode::Ptr Parser::buildCodeBlock() {
 			view = asSegment->segment;
 			auto ltrim = std::find_if(view.begin(), view.end(), firstNonSpaceOrNewline);
 			asSegment->segment.remove_prefix(std::distance(view.begin(), ltrim));
-			code->children.push_back(std::move(segment));
+			nodeStack.push_back(segment);
+			code->children = collectNodes(mark);
 			return code;
 		}
-		code->children.push_back(std::move(segment));
+		nodeStack.push_back(segment);
 
 		auto macro = buildMacro();
 		if(macro) {
-			code->children.push_back(std::move(macro));
+			nodeStack.push_back(macro);
 		}
 	}
 
@@ -243,7 +297,7 @@ AstNode::Ptr Parser::buildCodeBlock() {
 }
 
 AstNode::Ptr Parser::buildSegment(size_t &currentDepth) {
-	auto segmentNode = std::make_unique<SegmentAstNode>(&tokens[current]);
+	auto segmentNode = make<SegmentAstNode>(&tokens[current]);
 	auto& firstToken = tokens[current];
 	while(!eof()) {
 		const Token& token = tokens[current];
@@ -272,8 +326,8 @@ AstNode::Ptr Parser::buildSegment(size_t &currentDepth) {
 PARSING_DONE:
 	auto& lastToken = tokens[current];
 	segmentNode->segment = std::string_view(
-			src.c_str() + firstToken.index,
-			lastToken.index - firstToken.index
+			firstToken.begin,
+			lastToken.begin - firstToken.begin
 		);
 	return segmentNode;
 }
@@ -283,16 +337,22 @@ AstNode::Ptr Parser::buildMacro() {
 		return nullptr;
 	}
 
-	auto macro = std::make_unique<MacroAstNode>(&tokens[current - 1]);
+	auto macro = make<MacroAstNode>(&tokens[current - 1]);
 	auto string = getIf(TokenType::Identifier);
 	if(!string) {
-		error::onToken("Expected macro identifier", tokens[current]);
+		error::onToken("Expected macro identifier", currentToken());
 		return nullptr;
 	}
 
-	macro->name = string->value;
-	macro->children = std::move(buildMacroArgList());
-	macro->optionalCode = std::move(buildCodeBlock());
+	macro->name = string->str();
+	auto it = std::find(macroNames.cbegin(), macroNames.cend(), macro->name);
+	if(it == macroNames.cend()) {
+		error::onToken("Unrecognized macro: '" + std::string(macro->name) + "'", *string);
+		return nullptr;
+	}
+	macro->kind = static_cast<MacroKind>(std::distance(macroNames.cbegin(), it));
+	macro->children = buildMacroArgList();
+	macro->optionalCode = buildCodeBlock();
 
 	return macro;
 }
@@ -304,7 +364,7 @@ bool Parser::buildRequire(RootAstNode::Ptr &root) {
 
 	auto string = getIf(TokenType::Identifier);
 	if(!string) {
-		error::onToken("Expected file identifier", tokens[current]);
+		error::onToken("Expected file identifier", currentToken());
 		return false;
 	}
 
@@ -314,27 +374,40 @@ bool Parser::buildRequire(RootAstNode::Ptr &root) {
 		dir.remove_suffix(dir.size() - index);
 	}
 
-	std::string fileName = std::string(dir) + string->value + ".scv";
+	std::string fileName(dir);
+	fileName.append(string->str());
+	fileName.append(".scv");
+	if(deferredRequires) {
+		deferredRequires->push_back({
+			std::move(fileName),
+			string,
+			root->structs.size(),
+			root->traits.size(),
+			root->children.size(),
+		});
+		return true;
+	}
+
+	stats::Timer timer(stats::Phase::Requires);
 	if(Pipeline::hasProcessed(fileName)) {
 		return true;
 	}
-	auto& src = Pipeline::readFile(fileName);
+	auto src = Pipeline::readFile(fileName);
 	auto otherRoot = Pipeline::buildRootFromSrc(src, fileName);
-	otherRoot->origin = string;
 	root->join(otherRoot);
 
 	return true;
 }
 
-std::vector<AstNode::Ptr> Parser::buildMacroArgList() {
+AstNode::Children Parser::buildMacroArgList() {
 	if(!getIf(TokenType::LParens)) {
 		return {};
 	}
 
-	std::vector<AstNode::Ptr> args;
+	const size_t mark = nodeStack.size();
 	auto arg = buildMacro();
 	while(arg) {
-		args.push_back(std::move(arg));
+		nodeStack.push_back(arg);
 		if(!getIf(TokenType::Comma)) {
 			break;
 		}
@@ -342,15 +415,58 @@ std::vector<AstNode::Ptr> Parser::buildMacroArgList() {
 	}
 
 	if(!getIf(TokenType::RParens)) {
-		error::onToken("Expected closing paranthesis ')'", tokens[current]);
+		error::onToken("Expected closing paranthesis ')'", currentToken());
 		return {};
 	}
 
-	return args;
+	return collectNodes(mark);
+}
+
+// One or more comma separated identifiers
+bool Parser::buildNameList(Span<std::string_view>& names, const char* expected) {
+	const size_t mark = nameStack.size();
+	while(1) {
+		const Token* name = getIf(TokenType::Identifier);
+		if(!name) {
+			error::onToken(expected, currentToken());
+			return false;
+		}
+		nameStack.push_back(name->str());
+
+		if(!getIf(TokenType::Comma)) {
+			break;
+		}
+	}
+	names = collectNames(mark);
+	return true;
+}
+
+// Positive decimal numbers only
+bool Parser::buildNumber(uint32_t& value, const char* expected) {
+	const Token* number = getIf(TokenType::Number);
+	const auto digits = number ? number->str() : std::string_view();
+	const auto res = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+	if(!number || res.ec != std::errc() || res.ptr != digits.data() + digits.size() || value == 0) {
+		error::onToken(expected, number ? *number : currentToken());
+		return false;
+	}
+	return true;
+}
+
+AstNode::Children Parser::collectNodes(size_t mark) {
+	auto nodes = arena->copy(nodeStack.data() + mark, nodeStack.size() - mark);
+	nodeStack.resize(mark);
+	return nodes;
+}
+
+Span<std::string_view> Parser::collectNames(size_t mark) {
+	auto names = arena->copy(nameStack.data() + mark, nameStack.size() - mark);
+	nameStack.resize(mark);
+	return names;
 }
 
-std::vector<std::string> Parser::buildRequirements() {
-	std::vector<std::string> requirements;
+Span<std::string_view> Parser::buildRequirements() {
+	const size_t mark = nameStack.size();
 	const Token* token;
 	std::string requirement;
 
@@ -381,28 +497,24 @@ PARSE_REQUEST:
 		goto APPEND_REQUEST;
 	}
 
-	error::onToken("Expected requirement body, e.g \"header.hpp\" or <header.hpp>", tokens[current]);
+	error::onToken("Expected requirement body, e.g \"header.hpp\" or <header.hpp>", currentToken());
 	goto DONE;
 	
 APPEND_REQUEST:
-	requirements.push_back(requirement);
+	nameStack.push_back(arena->copy(requirement));
 	requirement.clear();
 	if(getIf(TokenType::Comma)) {
 		goto PARSE_REQUEST;
 	}
 
 DONE:
-	return requirements;
+	return collectNames(mark);
 }
 
 std::string Parser::joinTokenValuesUntilToken(TokenType delim) {
 	std::string join;
 	for(auto token = getIfNot(delim); token; token = getIfNot(delim)) {
-		if(!token->value.empty()) {
-			join += token->value;
-		} else {
-			join += tokenStrings[static_cast<size_t>(token->type)];
-		}
+		join += token->str();
 	}
 	return join;
 }
@@ -421,6 +533,11 @@ const Token* Parser::getIfNot(TokenType type) {
 	return &tokens[current++];
 }
 
+// Errors reported past the end of input point to the last token
+const Token& Parser::currentToken() const {
+	return eof() ? tokens.back() : tokens[current];
+}
+
 bool Parser::eof() const {
 	return current >= last;
 }
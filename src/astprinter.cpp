@@ -19,6 +19,19 @@ void AstPrinter::visit(const RootAstNode& node) {
 void AstPrinter::visit(const StructAstNode& node) {
 	pad();
 	std::cout << "Struct: " << node.name;
+	if(!node.options.empty()) {
+		std::cout << "\n";
+		pad();
+		std::cout << "options (\n";
+		dig();
+		for(const auto& option : node.options) {
+			pad();
+			std::cout << option << '\n';
+		}
+		rise();
+		pad();
+		std::cout << ")";
+	}
 	if(!node.traits.empty()) {
 		std::cout << "\n";
 		pad();
@@ -42,13 +55,33 @@ void AstPrinter::visit(const StructAstNode& node) {
 
 void AstPrinter::visit(const MemberAstNode& node) {
 	pad();
-	std::cout << "Member: " << node.name << ", Type: " << node.type << '\n';
+	std::cout << "Member: " << node.name << ", Type: " << (node.sequence ? "[" : "") << node.type;
+	if(node.capacity > 0) {
+		std::cout << '<' << node.capacity << '>';
+	}
+	if(node.sequence) {
+		std::cout << ']';
+	}
+	if(node.count > 0) {
+		std::cout << '[' << node.count << ']';
+	}
+	if(node.tag > 0) {
+		std::cout << " = " << node.tag;
+	}
+	for(const auto& option : node.options) {
+		std::cout << ", " << option;
+	}
+	std::cout << '\n';
 }
 
 void AstPrinter::visit(const TraitAstNode& node) {
 	pad();
 	std::cout << "Trait: " << node.name << '\n';
 	dig();
+	for(auto& option : node.options) {
+		pad();
+		std::cout << "Option: " << option << '\n';
+	}
 	for(auto& req : node.requirements) {
 		pad();
 		std::cout << "Requirement: " << req << '\n';
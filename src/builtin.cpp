@@ -0,0 +1,187 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <array>
+#include <string>
+
+bool Builtin::check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const {
+	const auto trait = symbols.findTrait(name());
+	for(const auto& member : struc.members) {
+		const auto structId = symbols.heldStruct(member.type);
+		if(structId != SymbolTable::none && !symbols.implements(structId, trait)) {
+			error::onToken("Member '" + std::string(member.node->name) + "' is of type '"
+				+ std::string(member.node->type) + "', which does not implement "
+				+ std::string(name()), *member.node->nameToken);
+			return false;
+		}
+	}
+	return true;
+}
+
+void Builtin::writePrelude(OutputWriter&) const {}
+
+bool Builtin::usesVarints() const {
+	return false;
+}
+
+void writeVarintPrelude(OutputWriter& output) {
+	output.append(R"(#ifndef SCV_VARINT_PRELUDE
+#define SCV_VARINT_PRELUDE
+namespace scv::varint {
+
+// Varints are LEB128, seven bits to a byte with the lowest bits first. Most
+// values take one or two bytes, which are handled before the general loop
+inline size_t size(uint64_t value) {
+#if defined(__GNUC__)
+	return (70 - __builtin_clzll(value | 1)) / 7;
+#else
+	size_t size = 1;
+	while(value >= 0x80) {
+		value >>= 7;
+		++size;
+	}
+	return size;
+#endif
+}
+
+inline std::byte* write(uint64_t value, std::byte* out) {
+	if(value < 0x80) {
+		out[0] = static_cast<std::byte>(value);
+		return out + 1;
+	}
+	if(value < 0x4000) {
+		out[0] = static_cast<std::byte>((value & 0x7f) | 0x80);
+		out[1] = static_cast<std::byte>(value >> 7);
+		return out + 2;
+	}
+	while(value >= 0x80) {
+		*out++ = static_cast<std::byte>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	*out++ = static_cast<std::byte>(value);
+	return out;
+}
+
+inline const std::byte* read(uint64_t& value, const std::byte* in, const std::byte* end) {
+	if(!in || in == end) {
+		return nullptr;
+	}
+	const auto first = static_cast<uint64_t>(in[0]);
+	if(first < 0x80) {
+		value = first;
+		return in + 1;
+	}
+	if(end - in >= 2 && static_cast<uint64_t>(in[1]) < 0x80) {
+		value = (first & 0x7f) | static_cast<uint64_t>(in[1]) << 7;
+		return in + 2;
+	}
+	value = 0;
+	for(unsigned shift = 0; shift < 64 && in != end; shift += 7) {
+		const auto byte = static_cast<uint64_t>(*in++);
+		value |= (byte & 0x7f) << shift;
+		if(byte < 0x80) {
+			return in;
+		}
+	}
+	return nullptr;
+}
+
+// Zigzag encoding interleaves negative and positive values, so that values
+// of small magnitude make small varints whatever their sign
+inline uint64_t zigzag(int64_t value) {
+	return static_cast<uint64_t>(value) << 1 ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+	return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+template<bool Zigzag, typename T>
+inline uint64_t encode(T value) {
+	if constexpr(std::is_signed_v<T>) {
+		return Zigzag ? zigzag(value) : static_cast<uint64_t>(static_cast<int64_t>(value));
+	} else {
+		return value;
+	}
+}
+
+// Fails on values out of range of the member read into
+template<bool Zigzag, typename T>
+inline const std::byte* read(T& value, const std::byte* in, const std::byte* end) {
+	uint64_t raw = 0;
+	in = read(raw, in, end);
+	if(!in) {
+		return nullptr;
+	}
+	if constexpr(std::is_signed_v<T>) {
+		const int64_t wide = Zigzag ? unzigzag(raw) : static_cast<int64_t>(raw);
+		if(wide < std::numeric_limits<T>::min() || wide > std::numeric_limits<T>::max()) {
+			return nullptr;
+		}
+		value = static_cast<T>(wide);
+	} else {
+		if(raw > std::numeric_limits<T>::max()) {
+			return nullptr;
+		}
+		value = static_cast<T>(raw);
+	}
+	return in;
+}
+
+}
+#endif
+
+)");
+}
+
+const Builtin* findBuiltin(std::string_view name) {
+	static const std::array<const Builtin*, 8> builtins = {
+		&binaryBuiltin(),
+		&soaBuiltin(),
+		&viewBuiltin(),
+		&batchBuiltin(),
+		&hashableBuiltin(),
+		&jsonBuiltin(),
+		&csvBuiltin(),
+		&taggedBuiltin(),
+	};
+
+	for(const auto builtin : builtins) {
+		if(builtin->name() == name) {
+			return builtin;
+		}
+	}
+	return nullptr;
+}
+
+bool writtenAsIs(const SymbolTable&, const SymbolTable::Member& member) {
+	return member.encoding == SymbolTable::Encoding::Fixed;
+}
+
+// A run starts aligned to its first member, so a later member lies right
+// after the one before it when its own alignment divides both that of the
+// first member and the bytes so far
+std::vector<MemberRun> memberRuns(const SymbolTable& symbols, const SymbolTable::Struct& struc, RunFilter joins) {
+	std::vector<MemberRun> runs;
+	uint32_t alignment = 0;
+	for(size_t i = 0; i < struc.layout.size(); i++) {
+		const auto& member = symbols.memberAt(struc, i);
+		const auto& type = symbols.types[member.type];
+		if(!type.fixedWidth() || !joins(symbols, member)) {
+			runs.push_back({i, 1, 0});
+			alignment = 0;
+			continue;
+		}
+
+		const uint32_t memberAlignment = symbols.alignmentOf(member.type);
+		if(alignment != 0 && memberAlignment <= alignment && runs.back().bytes % memberAlignment == 0) {
+			++runs.back().count;
+			runs.back().bytes += type.size;
+		} else {
+			runs.push_back({i, 1, type.size});
+			alignment = memberAlignment;
+		}
+	}
+	return runs;
+}
@@ -0,0 +1,323 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <string>
+
+namespace {
+
+// Arrays of structs written column by column: a u32 count, then for every
+// fixed width member in declaration order a column of little endian
+// values, then for every string member count + 1 u32 offsets followed by
+// the bytes of all its strings. Columns are gathered from the structs a
+// tile at a time, so that the structs being read stay in cache
+class BatchBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Batch";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<algorithm>", "<array>", "<cstddef>", "<cstdint>", "<cstring>", "<type_traits>", "<vector>"};
+		return requirements;
+	}
+
+	bool check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const override {
+		for(const auto& member : struc.members) {
+			const auto& type = symbols.types[member.type];
+			if(type.kind == SymbolTable::Kind::Struct) {
+				error::onToken("Member '" + std::string(member.node->name) + "' is a struct, which Batch cannot write as columns", *member.node->nameToken);
+				return false;
+			}
+			if(type.element != SymbolTable::none && !type.fixedWidth()) {
+				error::onToken("Member '" + std::string(member.node->name) + "' varies in size, which Batch cannot write as columns", *member.node->nameToken);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_BATCH_PRELUDE
+#define SCV_BATCH_PRELUDE
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SCV_BATCH_AVX2
+#include <immintrin.h>
+#endif
+namespace scv::batch {
+
+constexpr size_t tileSize = 256;
+
+// Inline strings are already bytes in order
+template<typename T>
+inline void toLittleEndian(T& value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if constexpr(std::is_arithmetic_v<T>) {
+		auto bytes = reinterpret_cast<unsigned char*>(&value);
+		std::reverse(bytes, bytes + sizeof(T));
+	}
+#else
+	(void)value;
+#endif
+}
+
+template<typename T, size_t N>
+inline void toLittleEndian(std::array<T, N>& values) {
+	for(auto& value : values) {
+		toLittleEndian(value);
+	}
+}
+
+template<typename T>
+inline void gatherScalar(const std::byte* first, size_t stride, size_t count, std::byte* out) {
+	for(size_t i = 0; i < count; i++) {
+		T value;
+		std::memcpy(&value, first + i * stride, sizeof(T));
+		toLittleEndian(value);
+		std::memcpy(out + i * sizeof(T), &value, sizeof(T));
+	}
+}
+
+template<typename T>
+inline void scatterScalar(const std::byte* in, size_t count, std::byte* first, size_t stride) {
+	for(size_t i = 0; i < count; i++) {
+		T value;
+		std::memcpy(&value, in + i * sizeof(T), sizeof(T));
+		toLittleEndian(value);
+		std::memcpy(first + i * stride, &value, sizeof(T));
+	}
+}
+
+#ifdef SCV_BATCH_AVX2
+inline bool hasAvx2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+__attribute__((target("avx2")))
+inline void gather32(const std::byte* first, size_t stride, size_t count, std::byte* out) {
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		const __m256i values = _mm256_i32gather_epi32(reinterpret_cast<const int*>(first + i * stride), index, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), values);
+	}
+	gatherScalar<uint32_t>(first + i * stride, stride, count - i, out + i * 4);
+}
+
+__attribute__((target("avx2")))
+inline void gather64(const std::byte* first, size_t stride, size_t count, std::byte* out) {
+	const auto step = static_cast<long long>(stride);
+	const __m256i index = _mm256_setr_epi64x(0, step, 2 * step, 3 * step);
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4) {
+		const __m256i values = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(first + i * stride), index, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 8), values);
+	}
+	gatherScalar<uint64_t>(first + i * stride, stride, count - i, out + i * 8);
+}
+#endif
+
+// Copies a member of each of count structs into a column
+template<typename T>
+inline void gather(const T* first, size_t stride, size_t count, std::byte* out) {
+	const auto bytes = reinterpret_cast<const std::byte*>(first);
+#ifdef SCV_BATCH_AVX2
+	if constexpr(sizeof(T) == 4) {
+		if(hasAvx2()) {
+			return gather32(bytes, stride, count, out);
+		}
+	} else if constexpr(sizeof(T) == 8) {
+		if(hasAvx2()) {
+			return gather64(bytes, stride, count, out);
+		}
+	}
+#endif
+	gatherScalar<T>(bytes, stride, count, out);
+}
+
+template<typename T>
+inline void scatter(const std::byte* in, size_t count, T* first, size_t stride) {
+	scatterScalar<T>(in, count, reinterpret_cast<std::byte*>(first), stride);
+}
+
+template<typename T, typename String>
+inline std::byte* writeStrings(const T* values, size_t count, String T::* member, std::byte* out) {
+	uint32_t offset = 0;
+	std::byte* heap = out + (count + 1) * sizeof(uint32_t);
+	for(size_t i = 0; i < count; i++) {
+		const auto& str = values[i].*member;
+		uint32_t littleOffset = offset;
+		toLittleEndian(littleOffset);
+		std::memcpy(out + i * sizeof(uint32_t), &littleOffset, sizeof(uint32_t));
+		std::memcpy(heap + offset, str.data(), str.size());
+		offset += static_cast<uint32_t>(str.size());
+	}
+	toLittleEndian(offset);
+	std::memcpy(out + count * sizeof(uint32_t), &offset, sizeof(uint32_t));
+	toLittleEndian(offset);
+	return heap + offset;
+}
+
+template<typename T, typename String>
+inline const std::byte* readStrings(T* values, size_t count, String T::* member, const std::byte* in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) < (count + 1) * sizeof(uint32_t)) {
+		return nullptr;
+	}
+	const std::byte* heap = in + (count + 1) * sizeof(uint32_t);
+	const size_t heapSize = end - heap;
+	uint32_t offset;
+	std::memcpy(&offset, in, sizeof(uint32_t));
+	toLittleEndian(offset);
+	if(offset > heapSize) {
+		return nullptr;
+	}
+	for(size_t i = 0; i < count; i++) {
+		uint32_t next;
+		std::memcpy(&next, in + (i + 1) * sizeof(uint32_t), sizeof(uint32_t));
+		toLittleEndian(next);
+		if(next < offset || next > heapSize) {
+			return nullptr;
+		}
+		(values[i].*member).assign(reinterpret_cast<const char*>(heap + offset), next - offset);
+		offset = next;
+	}
+	return heap + offset;
+}
+
+// Fails unless the input is large enough for count values, before anything
+// is allocated for them
+inline const std::byte* readCount(uint32_t& count, size_t bytesPerValue, const std::byte* in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) < sizeof(uint32_t)) {
+		return nullptr;
+	}
+	std::memcpy(&count, in, sizeof(uint32_t));
+	toLittleEndian(count);
+	in += sizeof(uint32_t);
+	if(bytesPerValue > 0 && static_cast<size_t>(end - in) / bytesPerValue < count) {
+		return nullptr;
+	}
+	return in;
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const std::string type(struc.node->name);
+		size_t fixed = 0;
+		size_t nStrings = 0;
+		for(const auto& member : struc.members) {
+			const auto& memberType = symbols.types[member.type];
+			if(memberType.fixedWidth()) {
+				fixed += memberType.size;
+			} else {
+				++nStrings;
+			}
+		}
+		const std::string strings = std::to_string(nStrings);
+		const std::string perValue = std::to_string(fixed + nStrings * 4);
+
+		std::string str;
+		str.append("inline size_t encodedBatchSize(const " + type + "* values, size_t count) {\n");
+		str.append("\tsize_t size = sizeof(uint32_t) + count * " + std::to_string(fixed) + ";\n");
+		if(nStrings > 0) {
+			str.append("\tsize += " + strings + " * (count + 1) * sizeof(uint32_t);\n");
+			str.append("\tfor(size_t i = 0; i < count; i++) {\n\t\tsize += ");
+			std::string sum;
+			for(const auto& member : struc.members) {
+				if(!symbols.types[member.type].fixedWidth()) {
+					sum.append(sum.empty() ? "" : " + ").append("values[i].").append(member.node->name).append(".size()");
+				}
+			}
+			str.append(sum + ";\n\t}\n");
+		} else {
+			str.append("\t(void)values;\n");
+		}
+		str.append("\treturn size;\n}\n\n");
+
+		str.append("inline std::byte* encodeBatch(const " + type + "* values, size_t count, std::byte* out) {\n");
+		str.append("\tuint32_t size = static_cast<uint32_t>(count);\n\tscv::batch::toLittleEndian(size);\n");
+		str.append("\tstd::memcpy(out, &size, sizeof(size));\n\tout += sizeof(size);\n");
+		writeTiles(symbols, struc, "gather(&block->", ", sizeof(" + type + "), n, out + ", ")", str);
+		str.append("\tout += count * " + std::to_string(fixed) + ";\n");
+		for(const auto& member : struc.members) {
+			if(!symbols.types[member.type].fixedWidth()) {
+				str.append("\tout = scv::batch::writeStrings(values, count, &" + type + "::").append(member.node->name).append(", out);\n");
+			}
+		}
+		str.append("\treturn out;\n}\n\n");
+
+		str.append("// Replaces the values with those read, returning the end of what was read\n");
+		str.append("// or null if the input is cut short. Values take their allocator from the\n");
+		str.append("// vector, so that a std::pmr::vector decodes into its memory resource\n");
+		str.append("template<typename Allocator>\n");
+		str.append("inline const std::byte* decodeBatch(std::vector<" + type + ", Allocator>& values, const std::byte* in, const std::byte* end) {\n");
+		str.append("\tuint32_t count;\n\tin = scv::batch::readCount(count, " + perValue + ", in, end);\n");
+		str.append("\tif(!in) {\n\t\treturn nullptr;\n\t}\n");
+		str.append("\tvalues.clear();\n\tvalues.resize(count);\n");
+		str.append("\t" + type + "* data = values.data();\n");
+		writeTiles(symbols, struc, "scatter(in + ", ", n, &block->", ", sizeof(" + type + "))", str);
+		str.append("\tin += count * " + std::to_string(fixed) + ";\n");
+		for(const auto& member : struc.members) {
+			if(!symbols.types[member.type].fixedWidth()) {
+				str.append("\tin = scv::batch::readStrings(data, count, &" + type + "::").append(member.node->name).append(", in, end);\n");
+			}
+		}
+		str.append("\treturn in;\n}\n\n");
+
+		str.append("#if __cplusplus >= 202002L\n");
+		str.append("inline size_t encodedBatchSize(std::span<const " + type + "> values) {\n");
+		str.append("\treturn encodedBatchSize(values.data(), values.size());\n}\n\n");
+		str.append("inline std::byte* encodeBatch(std::span<const " + type + "> values, std::byte* out) {\n");
+		str.append("\treturn encodeBatch(values.data(), values.size(), out);\n}\n");
+		str.append("#endif\n\n");
+
+		output.append(str);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 2048 + struc.members.size() * 256;
+	}
+
+private:
+	// Gathers or scatters every fixed width column a tile of structs at a time.
+	// Each column starts where the one before it ends
+	static void writeTiles(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::string& call, const std::string& middle, const std::string& last, std::string& str) {
+		const bool gathering = call.rfind("gather", 0) == 0;
+		str.append("\tfor(size_t tile = 0; tile < count; tile += scv::batch::tileSize) {\n");
+		str.append("\t\tconst size_t n = std::min(count - tile, scv::batch::tileSize);\n");
+		str.append(gathering ? "\t\tconst auto block = values + tile;\n" : "\t\tconst auto block = data + tile;\n");
+		size_t column = 0;
+		for(const auto& member : struc.members) {
+			const auto& type = symbols.types[member.type];
+			if(!type.fixedWidth()) {
+				continue;
+			}
+			const std::string position = (column > 0 ? "count * " + std::to_string(column) + " + " : "")
+				+ "tile * " + std::to_string(type.size);
+			str.append("\t\tscv::batch::");
+			if(gathering) {
+				str.append(call).append(member.node->name).append(middle + position + last);
+			} else {
+				str.append(call + position + middle).append(member.node->name).append(last);
+			}
+			str.append(";\n");
+			column += type.size;
+		}
+		str.append("\t}\n");
+	}
+};
+
+}
+
+const Builtin& batchBuiltin() {
+	static const BatchBuiltin builtin;
+	return builtin;
+}
@@ -0,0 +1,346 @@
+#include "builtin.hpp"
+
+#include <string>
+
+namespace {
+
+// Members are written in the order they lie in memory in their native byte
+// order, fixed width runs as one block and strings prefixed with their
+// length as a u32. Nested structs are written in place
+class BinaryBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Binary";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<cstddef>", "<cstdint>", "<cstring>", "<limits>", "<type_traits>"};
+		return requirements;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_BINARY_PRELUDE
+#define SCV_BINARY_PRELUDE
+namespace scv::binary {
+
+static_assert(sizeof(int) == 4 && alignof(int64_t) == 8 && alignof(uint64_t) == 8 && alignof(double) == 8 && sizeof(bool) == 1,
+	"scv copies members as they lie in memory, which needs naturally aligned primitives");
+
+// Strings may be std::string or std::pmr::string
+template<typename String>
+inline std::byte* writeString(const String& str, std::byte* out) {
+	const uint32_t size = static_cast<uint32_t>(str.size());
+	std::memcpy(out, &size, sizeof(size));
+	std::memcpy(out + sizeof(size), str.data(), size);
+	return out + sizeof(size) + size;
+}
+
+inline const std::byte* read(void* dst, size_t size, const std::byte* in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) < size) {
+		return nullptr;
+	}
+	std::memcpy(dst, in, size);
+	return in + size;
+}
+
+template<typename String>
+inline const std::byte* readString(String& str, const std::byte* in, const std::byte* end) {
+	uint32_t size;
+	in = read(&size, sizeof(size), in, end);
+	if(!in || static_cast<size_t>(end - in) < size) {
+		return nullptr;
+	}
+	str.assign(reinterpret_cast<const char*>(in), size);
+	return in + size;
+}
+
+// Sequences are prefixed with their count as a u32, and their elements are
+// written one after another, as a single block when of fixed width
+inline std::byte* writeCount(size_t count, std::byte* out) {
+	const uint32_t size = static_cast<uint32_t>(count);
+	std::memcpy(out, &size, sizeof(size));
+	return out + sizeof(size);
+}
+
+template<typename T>
+inline std::byte* writeBlock(const T* values, size_t count, std::byte* out) {
+	if(count > 0) {
+		std::memcpy(out, values, count * sizeof(T));
+	}
+	return out + count * sizeof(T);
+}
+
+template<typename T>
+inline const std::byte* readBlock(T* values, size_t count, const std::byte* in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) / sizeof(T) < count) {
+		return nullptr;
+	}
+	if(count > 0) {
+		std::memcpy(values, in, count * sizeof(T));
+	}
+	return in + count * sizeof(T);
+}
+
+// Resizes the sequence once, after checking that the rest of the input can
+// hold as many elements of at least the given size
+template<typename Sequence>
+inline const std::byte* readCount(Sequence& values, size_t bytesPerElement, const std::byte* in, const std::byte* end) {
+	uint32_t count;
+	in = read(&count, sizeof(count), in, end);
+	if(!in || (bytesPerElement > 0 && static_cast<size_t>(end - in) / bytesPerElement < count)) {
+		return nullptr;
+	}
+	values.resize(count);
+	return in;
+}
+
+template<typename Strings>
+inline size_t stringsSize(const Strings& strings) {
+	size_t size = strings.size() * sizeof(uint32_t);
+	for(const auto& str : strings) {
+		size += str.size();
+	}
+	return size;
+}
+
+template<typename Strings>
+inline std::byte* writeStrings(const Strings& strings, std::byte* out) {
+	for(const auto& str : strings) {
+		out = writeString(str, out);
+	}
+	return out;
+}
+
+template<typename Strings>
+inline const std::byte* readStrings(Strings& strings, const std::byte* in, const std::byte* end) {
+	for(auto& str : strings) {
+		in = readString(str, in, end);
+	}
+	return in;
+}
+
+}
+#endif
+
+)");
+	}
+
+	bool usesVarints() const override {
+		return true;
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const auto runs = memberRuns(symbols, struc);
+		writeSize(symbols, struc, runs, output);
+		writeSerialize(symbols, struc, runs, output);
+		writeDeserialize(symbols, struc, runs, output);
+		writeArrays(struc, output);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 512 + struc.members.size() * 160;
+	}
+
+private:
+	static std::string_view memberName(const SymbolTable& symbols, const SymbolTable::Struct& struc, const MemberRun& run) {
+		return symbols.memberAt(struc, run.first).node->name;
+	}
+
+	static SymbolTable::Kind kind(const SymbolTable& symbols, const SymbolTable::Struct& struc, const MemberRun& run) {
+		return symbols.types[symbols.memberAt(struc, run.first).type].kind;
+	}
+
+	static SymbolTable::Encoding encoding(const SymbolTable& symbols, const SymbolTable::Struct& struc, const MemberRun& run) {
+		return symbols.memberAt(struc, run.first).encoding;
+	}
+
+	// Element type of arrays and sequences which are not written as they lie
+	// in memory
+	static const SymbolTable::Type* elementOf(const SymbolTable& symbols, const SymbolTable::Struct& struc, const MemberRun& run) {
+		const auto element = symbols.types[symbols.memberAt(struc, run.first).type].element;
+		return element != SymbolTable::none ? &symbols.types[element] : nullptr;
+	}
+
+	// Fewest bytes a value of the type is written in, or for sequences a
+	// single element of them, which bounds how many elements the rest of an
+	// input can hold. Structs are written after the structs they hold, so
+	// this always ends
+	static size_t minimumSize(const SymbolTable& symbols, SymbolTable::Id id) {
+		const auto& type = symbols.types[id];
+		if(type.fixedWidth()) {
+			return type.size;
+		}
+		switch(type.kind) {
+			case SymbolTable::Kind::String:
+				return sizeof(uint32_t);
+			case SymbolTable::Kind::Array:
+				return type.count * minimumSize(symbols, type.element);
+			case SymbolTable::Kind::Sequence:
+				return minimumSize(symbols, type.element);
+			default:
+				break;
+		}
+
+		size_t size = 0;
+		for(const auto& member : symbols.structs[type.structId].members) {
+			const auto& memberType = symbols.types[member.type];
+			if(member.encoding != SymbolTable::Encoding::Fixed) {
+				size += 1;
+			} else if(memberType.kind == SymbolTable::Kind::Sequence) {
+				size += sizeof(uint32_t);
+			} else {
+				size += minimumSize(symbols, member.type);
+			}
+		}
+		return size;
+	}
+
+	static std::string_view zigzagged(const SymbolTable& symbols, const SymbolTable::Struct& struc, const MemberRun& run) {
+		return encoding(symbols, struc, run) == SymbolTable::Encoding::Zigzag ? "true" : "false";
+	}
+
+	void writeSize(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::vector<MemberRun>& runs, OutputWriter& output) const {
+		size_t fixed = 0;
+		std::string variable;
+		for(const auto& run : runs) {
+			const auto member = memberName(symbols, struc, run);
+			if(run.bytes > 0) {
+				fixed += run.bytes;
+			} else if(encoding(symbols, struc, run) != SymbolTable::Encoding::Fixed) {
+				variable.append(" + scv::varint::size(scv::varint::encode<").append(zigzagged(symbols, struc, run));
+				variable.append(">(value.").append(member).append("))");
+			} else if(kind(symbols, struc, run) == SymbolTable::Kind::String) {
+				fixed += sizeof(uint32_t);
+				variable.append(" + value.").append(member).append(".size()");
+			} else if(const auto element = elementOf(symbols, struc, run); element) {
+				const std::string values = "value." + std::string(member);
+				if(kind(symbols, struc, run) == SymbolTable::Kind::Sequence) {
+					fixed += sizeof(uint32_t);
+				}
+				if(element->fixedWidth()) {
+					variable.append(" + " + values + ".size() * " + std::to_string(element->size));
+				} else if(element->kind == SymbolTable::Kind::String) {
+					variable.append(" + scv::binary::stringsSize(" + values + ")");
+				} else {
+					variable.append(" + serializedSize(" + values + ".data(), " + values + ".size())");
+				}
+			} else {
+				variable.append(" + serializedSize(value.").append(member).append(")");
+			}
+		}
+
+		output.append("inline size_t serializedSize(const ");
+		output.append(struc.node->name);
+		output.append(variable.empty() ? "&) {\n\treturn " : "& value) {\n\treturn ");
+		output.append(std::to_string(fixed));
+		output.append(variable);
+		output.append(";\n}\n\n");
+	}
+
+	void writeSerialize(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::vector<MemberRun>& runs, OutputWriter& output) const {
+		output.append("inline std::byte* serialize(const ");
+		output.append(struc.node->name);
+		output.append(runs.empty() ? "&, std::byte* out) {\n" : "& value, std::byte* out) {\n");
+		for(const auto& run : runs) {
+			const auto member = memberName(symbols, struc, run);
+			if(run.bytes > 0) {
+				const auto bytes = std::to_string(run.bytes);
+				output.append("\tstd::memcpy(out, &value.");
+				output.append(member);
+				output.append(", " + bytes + ");\n\tout += " + bytes + ";\n");
+			} else if(encoding(symbols, struc, run) != SymbolTable::Encoding::Fixed) {
+				output.append("\tout = scv::varint::write(scv::varint::encode<");
+				output.append(zigzagged(symbols, struc, run));
+				output.append(">(value.");
+				output.append(member);
+				output.append("), out);\n");
+			} else if(kind(symbols, struc, run) == SymbolTable::Kind::String) {
+				output.append("\tout = scv::binary::writeString(value.");
+				output.append(member);
+				output.append(", out);\n");
+			} else if(const auto element = elementOf(symbols, struc, run); element) {
+				const std::string values = "value." + std::string(member);
+				if(kind(symbols, struc, run) == SymbolTable::Kind::Sequence) {
+					output.append("\tout = scv::binary::writeCount(" + values + ".size(), out);\n");
+				}
+				if(element->fixedWidth()) {
+					output.append("\tout = scv::binary::writeBlock(" + values + ".data(), " + values + ".size(), out);\n");
+				} else if(element->kind == SymbolTable::Kind::String) {
+					output.append("\tout = scv::binary::writeStrings(" + values + ", out);\n");
+				} else {
+					output.append("\tout = serialize(" + values + ".data(), " + values + ".size(), out);\n");
+				}
+			} else {
+				output.append("\tout = serialize(value.");
+				output.append(member);
+				output.append(", out);\n");
+			}
+		}
+		output.append("\treturn out;\n}\n\n");
+	}
+
+	void writeDeserialize(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::vector<MemberRun>& runs, OutputWriter& output) const {
+		output.append("// Returns the end of what was read, or null if the input ends too soon\n");
+		output.append("inline const std::byte* deserialize(");
+		output.append(struc.node->name);
+		output.append(runs.empty() ? "&, const std::byte* in, const std::byte*) {\n" : "& value, const std::byte* in, const std::byte* end) {\n");
+		for(const auto& run : runs) {
+			const auto member = memberName(symbols, struc, run);
+			if(run.bytes > 0) {
+				output.append("\tin = scv::binary::read(&value.");
+				output.append(member);
+				output.append(", " + std::to_string(run.bytes) + ", in, end);\n");
+			} else if(encoding(symbols, struc, run) != SymbolTable::Encoding::Fixed) {
+				output.append("\tin = scv::varint::read<");
+				output.append(zigzagged(symbols, struc, run));
+				output.append(">(value.");
+				output.append(member);
+				output.append(", in, end);\n");
+			} else if(kind(symbols, struc, run) == SymbolTable::Kind::String) {
+				output.append("\tin = scv::binary::readString(value.");
+				output.append(member);
+				output.append(", in, end);\n");
+			} else if(const auto element = elementOf(symbols, struc, run); element) {
+				const std::string values = "value." + std::string(member);
+				if(kind(symbols, struc, run) == SymbolTable::Kind::Sequence) {
+					const auto bytesPerElement = std::to_string(minimumSize(symbols, symbols.memberAt(struc, run.first).type));
+					output.append("\tin = scv::binary::readCount(" + values + ", " + bytesPerElement + ", in, end);\n");
+				}
+				if(element->fixedWidth()) {
+					output.append("\tin = scv::binary::readBlock(" + values + ".data(), " + values + ".size(), in, end);\n");
+				} else if(element->kind == SymbolTable::Kind::String) {
+					output.append("\tin = scv::binary::readStrings(" + values + ", in, end);\n");
+				} else {
+					output.append("\tin = deserialize(" + values + ".data(), " + values + ".size(), in, end);\n");
+				}
+			} else {
+				output.append("\tin = in ? deserialize(value.");
+				output.append(member);
+				output.append(", in, end) : nullptr;\n");
+			}
+		}
+		output.append("\treturn in;\n}\n\n");
+	}
+
+	// Arrays of values are sized in one pass, so that they can be written
+	// into a single allocation
+	void writeArrays(const SymbolTable::Struct& struc, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		output.append("inline size_t serializedSize(const " + type + "* values, size_t count) {\n");
+		output.append("\tsize_t size = 0;\n\tfor(size_t i = 0; i < count; i++) {\n");
+		output.append("\t\tsize += serializedSize(values[i]);\n\t}\n\treturn size;\n}\n\n");
+		output.append("inline std::byte* serialize(const " + type + "* values, size_t count, std::byte* out) {\n");
+		output.append("\tfor(size_t i = 0; i < count; i++) {\n");
+		output.append("\t\tout = serialize(values[i], out);\n\t}\n\treturn out;\n}\n\n");
+		output.append("inline const std::byte* deserialize(" + type + "* values, size_t count, const std::byte* in, const std::byte* end) {\n");
+		output.append("\tfor(size_t i = 0; i < count && in; i++) {\n");
+		output.append("\t\tin = deserialize(values[i], in, end);\n\t}\n\treturn in;\n}\n\n");
+	}
+};
+
+}
+
+const Builtin& binaryBuiltin() {
+	static const BinaryBuiltin builtin;
+	return builtin;
+}
@@ -0,0 +1,426 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <string>
+
+namespace {
+
+// One line per struct, with a column per member in declaration order named
+// by an optional header line. Fields are read with from_chars and written
+// with to_chars, and strings holding delimiters, quotes or line ends are
+// quoted. Large inputs are split at line ends outside of quotes and parsed
+// on several threads
+class CsvBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Csv";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<algorithm>", "<charconv>", "<cstddef>", "<cstdint>", "<cstdio>", "<cstring>",
+			"<iterator>", "<string>", "<string_view>", "<system_error>", "<thread>", "<type_traits>", "<vector>"};
+		return requirements;
+	}
+
+	bool check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const override {
+		if(struc.members.empty()) {
+			error::onToken("Struct '" + std::string(struc.node->name) + "' has no members, which Csv needs as columns", *struc.node->origin);
+			return false;
+		}
+		for(const auto& member : struc.members) {
+			const auto kind = symbols.types[member.type].kind;
+			if(kind == SymbolTable::Kind::Struct || kind == SymbolTable::Kind::Array || kind == SymbolTable::Kind::Sequence) {
+				error::onToken("Member '" + std::string(member.node->name) + "' holds more than one value, which Csv cannot write as a column", *member.node->nameToken);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_CSV_PRELUDE
+#define SCV_CSV_PRELUDE
+#if defined(__unix__) || defined(__APPLE__)
+#define SCV_CSV_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+namespace scv::csv {
+
+struct Options {
+	// Whether the input starts with a line naming the members in order
+	bool header = true;
+	// Threads parsing large inputs, 0 using one per hardware thread
+	unsigned threads = 0;
+};
+
+// Inputs are only split between threads in parts of at least this size
+constexpr size_t minimumPartSize = 1 << 20;
+
+// The contents of a file, mapped into memory where the platform allows and
+// read into memory otherwise
+class MappedFile {
+public:
+	explicit MappedFile(const char* path) {
+#ifdef SCV_CSV_MMAP
+		const int fd = ::open(path, O_RDONLY);
+		if(fd < 0) {
+			return;
+		}
+		struct stat status;
+		if(::fstat(fd, &status) == 0) {
+			length = static_cast<size_t>(status.st_size);
+			void* mapping = length > 0 ? ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+			if(mapping != MAP_FAILED) {
+				bytes = static_cast<const char*>(mapping);
+				mapped = true;
+			}
+			opened = mapped || length == 0;
+		}
+		::close(fd);
+#else
+		std::FILE* file = std::fopen(path, "rb");
+		if(!file) {
+			return;
+		}
+		char block[64 * 1024];
+		for(size_t n; (n = std::fread(block, 1, sizeof(block), file)) > 0;) {
+			contents.append(block, n);
+		}
+		opened = !std::ferror(file);
+		std::fclose(file);
+		bytes = contents.data();
+		length = contents.size();
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+#ifdef SCV_CSV_MMAP
+		if(mapped) {
+			::munmap(const_cast<char*>(bytes), length);
+		}
+#endif
+	}
+
+	bool valid() const { return opened; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+private:
+	const char* bytes = "";
+	size_t length = 0;
+	bool opened = false;
+	bool mapped = false;
+#ifndef SCV_CSV_MMAP
+	std::string contents;
+#endif
+};
+
+inline bool atFieldEnd(const char* in, const char* end) {
+	return in == end || *in == ',' || *in == '\n' || *in == '\r';
+}
+
+// Quoted fields end at a quote which is not doubled, and may hold
+// delimiters and line ends
+template<typename String>
+inline const char* readQuoted(String& value, const char* in, const char* end) {
+	auto quote = static_cast<const char*>(std::memchr(in, '"', end - in));
+	if(quote && (quote + 1 == end || quote[1] != '"')) {
+		value = std::string_view(in, quote - in);
+		return quote + 1;
+	}
+	std::string scratch;
+	while(quote) {
+		scratch.append(in, quote + 1);
+		in = quote + 2;
+		quote = static_cast<const char*>(std::memchr(in, '"', end - in));
+		if(quote && (quote + 1 == end || quote[1] != '"')) {
+			scratch.append(in, quote);
+			value = std::string_view(scratch);
+			return quote + 1;
+		}
+	}
+	return nullptr;
+}
+
+// Numbers, bools and strings, failing on numbers out of range of the member
+// read into. Empty fields leave the member alone
+template<typename T>
+inline const char* read(T& value, const char* in, const char* end) {
+	if(!in || atFieldEnd(in, end)) {
+		return in;
+	}
+	if constexpr(std::is_same_v<T, bool>) {
+		if(*in == '0' || *in == '1') {
+			value = *in == '1';
+			return in + 1;
+		} else if(end - in >= 4 && std::memcmp(in, "true", 4) == 0) {
+			value = true;
+			return in + 4;
+		} else if(end - in >= 5 && std::memcmp(in, "false", 5) == 0) {
+			value = false;
+			return in + 5;
+		}
+		return nullptr;
+	} else if constexpr(std::is_arithmetic_v<T>) {
+		const auto result = std::from_chars(in, end, value);
+		return result.ec == std::errc() ? result.ptr : nullptr;
+	} else {
+		if(*in == '"') {
+			return readQuoted(value, in + 1, end);
+		}
+		const auto start = in;
+		while(!atFieldEnd(in, end)) {
+			++in;
+		}
+		value = std::string_view(start, in - start);
+		return in;
+	}
+}
+
+inline const char* delimiter(const char* in, const char* end) {
+	return in && in != end && *in == ',' ? in + 1 : nullptr;
+}
+
+// A row ends at a line end or the end of the input
+inline const char* endRow(const char* in, const char* end) {
+	if(!in || in == end) {
+		return in;
+	}
+	if(*in == '\r' && ++in == end) {
+		return in;
+	}
+	return *in == '\n' ? in + 1 : nullptr;
+}
+
+// Bools are written as 1 and 0
+template<typename T>
+inline void write(const T& value, std::string& out) {
+	if constexpr(std::is_same_v<T, bool>) {
+		out.push_back(value ? '1' : '0');
+	} else if constexpr(std::is_arithmetic_v<T>) {
+		char buffer[32];
+		const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, result.ptr);
+	} else {
+		const std::string_view str(value);
+		if(str.find_first_of(",\"\r\n") == std::string_view::npos) {
+			out.append(str);
+			return;
+		}
+		out.push_back('"');
+		for(const char c : str) {
+			if(c == '"') {
+				out.push_back('"');
+			}
+			out.push_back(c);
+		}
+		out.push_back('"');
+	}
+}
+
+inline const char* skipEmptyLines(const char* in, const char* end) {
+	while(in != end && (*in == '\n' || (*in == '\r' && end - in >= 2 && in[1] == '\n'))) {
+		in += *in == '\n' ? 1 : 2;
+	}
+	return in;
+}
+
+// Skips a byte order mark, then checks the header when there is one
+inline const char* begin(std::string_view header, const Options& options, const char* in, const char* end) {
+	if(end - in >= 3 && std::memcmp(in, "\xef\xbb\xbf", 3) == 0) {
+		in += 3;
+	}
+	if(!options.header || in == end) {
+		return in;
+	}
+	const auto line = static_cast<const char*>(std::memchr(in, '\n', end - in));
+	std::string_view first(in, (line ? line : end) - in);
+	if(!first.empty() && first.back() == '\r') {
+		first.remove_suffix(1);
+	}
+	return first == header ? (line ? line + 1 : end) : nullptr;
+}
+
+// Splits the input into parts of about equal size at line ends. A line end
+// lies within quotes when an odd number of quotes come before it
+inline std::vector<const char*> split(const char* in, const char* end, size_t parts) {
+	std::vector<const char*> bounds{in};
+	const size_t step = static_cast<size_t>(end - in) / parts;
+	const char* counted = in;
+	bool quoted = false;
+	for(size_t i = 1; i < parts; i++) {
+		const char* at = std::max(in + i * step, bounds.back());
+		for(;;) {
+			const auto line = static_cast<const char*>(std::memchr(at, '\n', end - at));
+			if(!line) {
+				at = end;
+				break;
+			}
+			quoted = quoted != (std::count(counted, line, '"') % 2 == 1);
+			counted = line;
+			at = line + 1;
+			if(!quoted) {
+				break;
+			}
+		}
+		if(at == end) {
+			break;
+		}
+		bounds.push_back(at);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+template<typename T, typename Allocator, typename Parse>
+inline bool parseRows(std::vector<T, Allocator>& values, const char* in, const char* end, Parse parse) {
+	for(in = skipEmptyLines(in, end); in && in != end; in = skipEmptyLines(in, end)) {
+		in = parse(values.emplace_back(), in, end);
+		if(!in) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The first part is parsed on the calling thread straight into the values,
+// which the rows of the other parts are then moved onto the end of
+template<typename T, typename Allocator, typename Parse>
+inline bool read(std::vector<T, Allocator>& values, std::string_view header, const Options& options, const char* in, const char* end, Parse parse) {
+	values.clear();
+	in = begin(header, options, in, end);
+	if(!in) {
+		return false;
+	}
+	const size_t threads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	const size_t parts = std::min(threads, std::max<size_t>(1, static_cast<size_t>(end - in) / minimumPartSize));
+	if(parts == 1) {
+		return parseRows(values, in, end, parse);
+	}
+
+	const auto bounds = split(in, end, parts);
+	std::vector<std::vector<T, Allocator>> rows;
+	for(size_t i = 2; i < bounds.size(); i++) {
+		rows.emplace_back(values.get_allocator());
+	}
+	std::vector<char> parsed(rows.size());
+	std::vector<std::thread> workers;
+	for(size_t i = 0; i < rows.size(); i++) {
+		workers.emplace_back([&, i]() {
+			parsed[i] = parseRows(rows[i], bounds[i + 1], bounds[i + 2], parse);
+		});
+	}
+	bool ok = parseRows(values, bounds[0], bounds[1], parse);
+	for(auto& worker : workers) {
+		worker.join();
+	}
+
+	size_t count = values.size();
+	for(size_t i = 0; i < rows.size(); i++) {
+		ok = ok && parsed[i];
+		count += rows[i].size();
+	}
+	if(!ok) {
+		return false;
+	}
+	values.reserve(count);
+	for(auto& part : rows) {
+		values.insert(values.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+	}
+	return true;
+}
+
+template<typename T, typename Allocator, typename Parse, typename Callback>
+inline bool readChunks(std::vector<T, Allocator>& chunk, size_t rows, std::string_view header, const Options& options,
+	const char* in, const char* end, Parse parse, Callback& callback) {
+	chunk.clear();
+	in = begin(header, options, in, end);
+	for(in = in ? skipEmptyLines(in, end) : nullptr; in && in != end; in = skipEmptyLines(in, end)) {
+		in = parse(chunk.emplace_back(), in, end);
+		if(in && chunk.size() >= rows) {
+			callback(chunk);
+			chunk.clear();
+		}
+	}
+	if(in && !chunk.empty()) {
+		callback(chunk);
+		chunk.clear();
+	}
+	return in;
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable&, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const std::string type(struc.node->name);
+		std::string header;
+		for(const auto& member : struc.members) {
+			header.append(header.empty() ? "" : ",").append(member.node->name);
+		}
+		const std::string parse = "[](" + type + "& row, const char* first, const char* last) {\n\t\treturn parseCsvRow(row, first, last);\n\t}";
+
+		std::string str;
+		str.append("// Returns the start of the next line, or null if the line does not hold a row\n");
+		str.append("inline const char* parseCsvRow(" + type + "& value, const char* in, const char* end) {\n");
+		for(size_t i = 0; i < struc.members.size(); i++) {
+			if(i > 0) {
+				str.append("\tin = scv::csv::delimiter(in, end);\n");
+			}
+			str.append("\tin = scv::csv::read(value.").append(struc.members[i].node->name).append(", in, end);\n");
+		}
+		str.append("\treturn scv::csv::endRow(in, end);\n}\n\n");
+
+		str.append("inline void writeCsvRow(const " + type + "& value, std::string& out) {\n");
+		for(size_t i = 0; i < struc.members.size(); i++) {
+			if(i > 0) {
+				str.append("\tout.push_back(',');\n");
+			}
+			str.append("\tscv::csv::write(value.").append(struc.members[i].node->name).append(", out);\n");
+		}
+		str.append("\tout.push_back('\\n');\n}\n\n");
+
+		str.append("// Appends the values to the buffer a line each, after a header line when asked for\n");
+		str.append("inline void writeCsv(const " + type + "* values, size_t count, std::string& out, bool header = true) {\n");
+		str.append("\tif(header) {\n\t\tout.append(\"" + header + "\\n\", " + std::to_string(header.size() + 1) + ");\n\t}\n");
+		str.append("\tfor(size_t i = 0; i < count; i++) {\n\t\twriteCsvRow(values[i], out);\n\t}\n}\n\n");
+
+		str.append("// Replaces the values with the rows read, failing on a malformed row or a\n");
+		str.append("// header which does not name the members in order. Empty lines are skipped\n");
+		str.append("template<typename Allocator>\n");
+		str.append("inline bool readCsv(std::vector<" + type + ", Allocator>& values, const char* in, const char* end, const scv::csv::Options& options = {}) {\n");
+		str.append("\treturn scv::csv::read(values, \"" + header + "\", options, in, end, " + parse + ");\n}\n\n");
+
+		str.append("template<typename Allocator>\n");
+		str.append("inline bool readCsvFile(std::vector<" + type + ", Allocator>& values, const char* path, const scv::csv::Options& options = {}) {\n");
+		str.append("\tconst scv::csv::MappedFile file(path);\n");
+		str.append("\treturn file.valid() && readCsv(values, file.data(), file.data() + file.size(), options);\n}\n\n");
+
+		str.append("// Reads rows into the chunk on the calling thread, handing it to the callback\n");
+		str.append("// in order each time it holds the given number of rows and once more at the end\n");
+		str.append("template<typename Allocator, typename Callback>\n");
+		str.append("inline bool readCsvChunks(std::vector<" + type + ", Allocator>& chunk, size_t rows, const char* in, const char* end, Callback&& callback, const scv::csv::Options& options = {}) {\n");
+		str.append("\treturn scv::csv::readChunks(chunk, rows, \"" + header + "\", options, in, end, " + parse + ", callback);\n}\n\n");
+		output.append(str);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 2048 + struc.members.size() * 128;
+	}
+};
+
+}
+
+const Builtin& csvBuiltin() {
+	static const CsvBuiltin builtin;
+	return builtin;
+}
@@ -0,0 +1,234 @@
+#include "builtin.hpp"
+
+#include <string>
+
+namespace {
+
+// A std::hash specialization and equality for structs used as keys of hash
+// maps. Runs of integers and bools lying next to each other in memory are
+// hashed and compared as one block of bytes, as are the elements of arrays
+// and sequences of them. Strings are hashed with wyhash, floats and nested
+// structs through std::hash. Floats never join a run, as equal floats need
+// not have equal bytes
+class HashableBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Hashable";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<cstddef>", "<cstdint>", "<cstring>", "<functional>"};
+		return requirements;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_HASH_PRELUDE
+#define SCV_HASH_PRELUDE
+namespace scv::hash {
+
+constexpr uint64_t secret0 = 0xa0761d6478bd642full;
+constexpr uint64_t secret1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t secret2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t secret3 = 0x589965cc75374cc3ull;
+
+// Full product of a and b, its low half left in a and its high half in b
+inline void multiply(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+	const __uint128_t product = static_cast<__uint128_t>(a) * b;
+	a = static_cast<uint64_t>(product);
+	b = static_cast<uint64_t>(product >> 64);
+#else
+	const uint64_t aHigh = a >> 32, aLow = static_cast<uint32_t>(a);
+	const uint64_t bHigh = b >> 32, bLow = static_cast<uint32_t>(b);
+	const uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow, middle1 = aLow * bHigh, low = aLow * bLow;
+	const uint64_t partial = low + (middle0 << 32);
+	const uint64_t sum = partial + (middle1 << 32);
+	b = high + (middle0 >> 32) + (middle1 >> 32) + (partial < low) + (sum < partial);
+	a = sum;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+	multiply(a, b);
+	return a ^ b;
+}
+
+inline uint64_t read8(const unsigned char* p) {
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint64_t read4(const unsigned char* p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// wyhash, which reads short inputs in at most four loads and long ones 48
+// bytes at a time in three independent lanes. Not cryptographic
+inline uint64_t bytes(const void* data, size_t size, uint64_t seed) {
+	auto p = static_cast<const unsigned char*>(data);
+	seed ^= mix(seed ^ secret0, secret1);
+	uint64_t a, b;
+	if(size <= 16) {
+		if(size >= 4) {
+			const size_t middle = (size >> 3) << 2;
+			a = read4(p) << 32 | read4(p + middle);
+			b = read4(p + size - 4) << 32 | read4(p + size - 4 - middle);
+		} else if(size > 0) {
+			a = static_cast<uint64_t>(p[0]) << 16 | static_cast<uint64_t>(p[size >> 1]) << 8 | p[size - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = size;
+		if(i > 48) {
+			uint64_t seed1 = seed, seed2 = seed;
+			do {
+				seed = mix(read8(p) ^ secret1, read8(p + 8) ^ seed);
+				seed1 = mix(read8(p + 16) ^ secret2, read8(p + 24) ^ seed1);
+				seed2 = mix(read8(p + 32) ^ secret3, read8(p + 40) ^ seed2);
+				p += 48;
+				i -= 48;
+			} while(i > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while(i > 16) {
+			seed = mix(read8(p) ^ secret1, read8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = read8(p + i - 16);
+		b = read8(p + i - 8);
+	}
+	a ^= secret1;
+	b ^= seed;
+	multiply(a, b);
+	return mix(a ^ secret0 ^ size, b ^ secret1);
+}
+
+// Folds the hash of a member into the hash of the members before it
+inline uint64_t combine(uint64_t seed, uint64_t value) {
+	return mix(seed ^ secret0, value ^ secret1);
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const auto runs = memberRuns(symbols, struc, comparedAsBytes);
+		writeHash(symbols, struc, runs, output);
+		writeEquality(symbols, struc, runs, output);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 768 + struc.members.size() * 128;
+	}
+
+private:
+	// Inline strings may hold bytes past their length once copied into
+	static bool comparedAsBytes(const SymbolTable& symbols, const SymbolTable::Member& member) {
+		const auto& type = symbols.types[member.type];
+		const auto kind = type.element != SymbolTable::none ? symbols.types[type.element].kind : type.kind;
+		return kind != SymbolTable::Kind::Float && kind != SymbolTable::Kind::InlineString;
+	}
+
+	// Folds a value into the hash, given its type
+	static std::string hashOf(const SymbolTable::Type& type, const std::string& value) {
+		switch(type.kind) {
+			case SymbolTable::Kind::String:
+			case SymbolTable::Kind::InlineString:
+				return "hash = scv::hash::bytes(" + value + ".data(), " + value + ".size(), hash);";
+			case SymbolTable::Kind::Float:
+			case SymbolTable::Kind::Struct:
+				return "hash = scv::hash::combine(hash, std::hash<" + std::string(type.spelling) + ">{}(" + value + "));";
+			default:
+				return "hash = scv::hash::combine(hash, static_cast<uint64_t>(" + value + "));";
+		}
+	}
+
+	// Members are hashed in the order they lie in memory. The hash is only
+	// read from the cached field when it has been precomputed, as structs
+	// are hashed through const references which are never written to
+	void writeHash(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::vector<MemberRun>& runs, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		std::string str;
+		str.append("inline size_t hashValue(const " + type + (runs.empty() ? "&) {\n" : "& value) {\n"));
+		str.append("\tuint64_t hash = 0;\n");
+		for(const auto& run : runs) {
+			const auto& member = symbols.memberAt(struc, run.first);
+			const std::string memberName(member.node->name);
+			const auto& memberType = symbols.types[member.type];
+			if(run.count > 1 || (run.bytes > 0 && memberType.kind == SymbolTable::Kind::Array)) {
+				str.append("\thash = scv::hash::bytes(&value." + memberName + ", " + std::to_string(run.bytes) + ", hash);\n");
+			} else if(memberType.element != SymbolTable::none && comparedAsBytes(symbols, member) && symbols.types[memberType.element].fixedWidth()) {
+				const auto& element = symbols.types[memberType.element];
+				str.append("\thash = scv::hash::bytes(value." + memberName + ".data(), value." + memberName + ".size() * ");
+				str.append(std::to_string(element.size) + ", hash);\n");
+			} else if(memberType.element != SymbolTable::none) {
+				str.append("\thash = scv::hash::combine(hash, value." + memberName + ".size());\n");
+				str.append("\tfor(const auto& element : value." + memberName + ") {\n");
+				str.append("\t\t" + hashOf(symbols.types[memberType.element], "element") + "\n\t}\n");
+			} else {
+				str.append("\t" + hashOf(memberType, "value." + memberName) + "\n");
+			}
+		}
+		str.append("\treturn static_cast<size_t>(hash);\n}\n\n");
+
+		str.append("namespace std {\n\ntemplate<>\nstruct hash<" + type + "> {\n");
+		str.append("\tsize_t operator()(const " + type + "& value) const noexcept {\n");
+		str.append(struc.cachedHash ? "\t\treturn value.hashPrecomputed != 0 ? value.hashPrecomputed : hashValue(value);\n" : "\t\treturn hashValue(value);\n");
+		str.append("\t}\n};\n\n}\n\n");
+
+		if(struc.cachedHash) {
+			str.append("// Caches the hash of a value, which must be precomputed again whenever the\n// value changes. Zero marks a hash that is not cached\n");
+			str.append("inline void precomputeHash(" + type + "& value) {\n");
+			str.append("\tconst size_t hash = hashValue(value);\n");
+			str.append("\tvalue.hashPrecomputed = hash != 0 ? hash : 1;\n}\n\n");
+		}
+		output.append(str);
+	}
+
+	// Fixed width members are compared before strings and nested structs,
+	// so that unequal values are usually told apart without a loop
+	void writeEquality(const SymbolTable& symbols, const SymbolTable::Struct& struc, const std::vector<MemberRun>& runs, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		std::string fixed;
+		std::string variable;
+		if(struc.cachedHash) {
+			fixed.append("(lhs.hashPrecomputed == 0 || rhs.hashPrecomputed == 0 || lhs.hashPrecomputed == rhs.hashPrecomputed)");
+		}
+		for(const auto& run : runs) {
+			const auto& member = symbols.memberAt(struc, run.first);
+			const std::string memberName(member.node->name);
+			auto& str = symbols.types[member.type].fixedWidth() ? fixed : variable;
+			if(!str.empty()) {
+				str.append("\n\t\t&& ");
+			}
+			if(run.count > 1) {
+				str.append("std::memcmp(&lhs." + memberName + ", &rhs." + memberName + ", " + std::to_string(run.bytes) + ") == 0");
+			} else {
+				str.append("lhs." + memberName + " == rhs." + memberName);
+			}
+		}
+		if(!fixed.empty() && !variable.empty()) {
+			fixed.append("\n\t\t&& ");
+		}
+		fixed.append(variable);
+
+		output.append("inline bool operator==(const " + type + (fixed.empty() ? "&, const " + type + "&) {\n\treturn true;\n}\n\n" : "& lhs, const " + type + "& rhs) {\n\treturn " + fixed + ";\n}\n\n"));
+		output.append("inline bool operator!=(const " + type + "& lhs, const " + type + "& rhs) {\n\treturn !(lhs == rhs);\n}\n\n");
+	}
+};
+
+}
+
+const Builtin& hashableBuiltin() {
+	static const HashableBuiltin builtin;
+	return builtin;
+}
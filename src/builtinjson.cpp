@@ -0,0 +1,605 @@
+#include "builtin.hpp"
+
+#include <string>
+
+namespace {
+
+// Objects are read by dispatching each key through a perfect hash of the
+// member names, found when generating, and a single comparison against the
+// name it selects. Unknown keys have their values skipped by scanning for
+// the brackets and quotes closing them. Numbers are read with from_chars and
+// written with to_chars into a buffer given by the caller
+class JsonBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Json";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<charconv>", "<cmath>", "<cstddef>", "<cstdint>", "<cstring>",
+			"<limits>", "<string>", "<string_view>", "<system_error>", "<type_traits>"};
+		return requirements;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_JSON_PRELUDE
+#define SCV_JSON_PRELUDE
+namespace scv::json {
+
+// Must match the hash scv places member names with
+inline uint32_t keyHash(const char* key, size_t size, uint32_t seed) {
+	uint32_t hash = seed ^ static_cast<uint32_t>(size);
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ static_cast<unsigned char>(key[i])) * 0x01000193u;
+	}
+	return hash ^ hash >> 15;
+}
+
+inline char* writeRaw(const char* data, size_t size, char* out, char* end) {
+	if(!out || static_cast<size_t>(end - out) < size) {
+		return nullptr;
+	}
+	std::memcpy(out, data, size);
+	return out + size;
+}
+
+// Characters which need no escaping are copied in spans between those that do
+inline char* writeString(std::string_view str, char* out, char* end) {
+	static constexpr char hex[] = "0123456789abcdef";
+	out = writeRaw("\"", 1, out, end);
+	size_t clean = 0;
+	for(size_t i = 0; i < str.size() && out; i++) {
+		const auto c = static_cast<unsigned char>(str[i]);
+		if(c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		out = writeRaw(str.data() + clean, i - clean, out, end);
+		clean = i + 1;
+		const char* escaped = c == '"' ? "\\\"" : c == '\\' ? "\\\\" : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : nullptr;
+		if(escaped) {
+			out = writeRaw(escaped, 2, out, end);
+		} else {
+			const char unicode[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+			out = writeRaw(unicode, sizeof(unicode), out, end);
+		}
+	}
+	out = writeRaw(str.data() + clean, str.size() - clean, out, end);
+	return writeRaw("\"", 1, out, end);
+}
+
+// Numbers, bools and strings. Floats which are not finite are written as null
+template<typename T>
+inline char* write(const T& value, char* out, char* end) {
+	if constexpr(std::is_same_v<T, bool>) {
+		return value ? writeRaw("true", 4, out, end) : writeRaw("false", 5, out, end);
+	} else if constexpr(std::is_arithmetic_v<T>) {
+		if constexpr(std::is_floating_point_v<T>) {
+			if(!std::isfinite(value)) {
+				return writeRaw("null", 4, out, end);
+			}
+		}
+		if(!out) {
+			return nullptr;
+		}
+		const auto result = std::to_chars(out, end, value);
+		return result.ec == std::errc() ? result.ptr : nullptr;
+	} else {
+		return writeString(std::string_view(value), out, end);
+	}
+}
+
+template<typename T>
+constexpr size_t maxScalarSize() {
+	if constexpr(std::is_same_v<T, bool>) {
+		return 5;
+	} else if constexpr(std::is_floating_point_v<T>) {
+		return std::numeric_limits<T>::max_digits10 + 8;
+	} else {
+		return std::numeric_limits<T>::digits10 + 2;
+	}
+}
+
+// Escapes take at most six characters for each byte of a string
+template<typename T>
+inline size_t maxSize(const T& value) {
+	if constexpr(std::is_arithmetic_v<T>) {
+		return maxScalarSize<T>();
+	} else {
+		return 2 + 6 * value.size();
+	}
+}
+
+inline const char* skipSpace(const char* in, const char* end) {
+	while(in && in != end && (*in == ' ' || *in == '\n' || *in == '\r' || *in == '\t')) {
+		++in;
+	}
+	return in;
+}
+
+inline const char* expect(char c, const char* in, const char* end) {
+	in = skipSpace(in, end);
+	return in && in != end && *in == c ? in + 1 : nullptr;
+}
+
+inline const char* readHex(uint32_t& code, const char* in, const char* end) {
+	if(end - in < 4) {
+		return nullptr;
+	}
+	code = 0;
+	for(int i = 0; i < 4; i++) {
+		const char c = in[i];
+		const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+		if(digit < 0) {
+			return nullptr;
+		}
+		code = code << 4 | static_cast<uint32_t>(digit);
+	}
+	return in + 4;
+}
+
+inline void appendUtf8(std::string& str, uint32_t code) {
+	if(code < 0x80) {
+		str.push_back(static_cast<char>(code));
+	} else if(code < 0x800) {
+		str.push_back(static_cast<char>(0xc0 | code >> 6));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+	} else if(code < 0x10000) {
+		str.push_back(static_cast<char>(0xe0 | code >> 12));
+		str.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+	} else {
+		str.push_back(static_cast<char>(0xf0 | code >> 18));
+		str.push_back(static_cast<char>(0x80 | (code >> 12 & 0x3f)));
+		str.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+	}
+}
+
+// Strings without escapes are returned as a view of the input, others are
+// decoded into the scratch string
+inline const char* readString(std::string_view& str, std::string& scratch, const char* in, const char* end) {
+	in = expect('"', in, end);
+	if(!in) {
+		return nullptr;
+	}
+	const auto quote = static_cast<const char*>(std::memchr(in, '"', end - in));
+	if(!quote) {
+		return nullptr;
+	}
+	const auto escape = static_cast<const char*>(std::memchr(in, '\\', quote - in));
+	if(!escape) {
+		str = std::string_view(in, quote - in);
+		return quote + 1;
+	}
+
+	scratch.assign(in, escape);
+	in = escape;
+	while(in != end) {
+		const char c = *in++;
+		if(c == '"') {
+			str = scratch;
+			return in;
+		} else if(c != '\\') {
+			scratch.push_back(c);
+			continue;
+		} else if(in == end) {
+			return nullptr;
+		}
+		switch(*in++) {
+			case '"': scratch.push_back('"'); break;
+			case '\\': scratch.push_back('\\'); break;
+			case '/': scratch.push_back('/'); break;
+			case 'b': scratch.push_back('\b'); break;
+			case 'f': scratch.push_back('\f'); break;
+			case 'n': scratch.push_back('\n'); break;
+			case 'r': scratch.push_back('\r'); break;
+			case 't': scratch.push_back('\t'); break;
+			case 'u': {
+				uint32_t code;
+				in = readHex(code, in, end);
+				if(!in) {
+					return nullptr;
+				} else if(code >= 0xd800 && code < 0xdc00) {
+					uint32_t low;
+					in = end - in >= 2 && in[0] == '\\' && in[1] == 'u' ? readHex(low, in + 2, end) : nullptr;
+					if(!in || low < 0xdc00 || low >= 0xe000) {
+						return nullptr;
+					}
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				} else if(code >= 0xdc00 && code < 0xe000) {
+					return nullptr;
+				}
+				appendUtf8(scratch, code);
+				break;
+			}
+			default:
+				return nullptr;
+		}
+	}
+	return nullptr;
+}
+
+// Numbers, bools and strings, which fail on values out of range of the
+// member read into. Floats read null as NaN. Strings are assigned, so inline
+// strings truncate those longer than their capacity
+template<typename T>
+inline const char* read(T& value, const char* in, const char* end) {
+	in = skipSpace(in, end);
+	if(!in) {
+		return nullptr;
+	}
+	if constexpr(std::is_same_v<T, bool>) {
+		if(end - in >= 4 && std::memcmp(in, "true", 4) == 0) {
+			value = true;
+			return in + 4;
+		} else if(end - in >= 5 && std::memcmp(in, "false", 5) == 0) {
+			value = false;
+			return in + 5;
+		}
+		return nullptr;
+	} else if constexpr(std::is_arithmetic_v<T>) {
+		if constexpr(std::is_floating_point_v<T>) {
+			if(end - in >= 4 && std::memcmp(in, "null", 4) == 0) {
+				value = std::numeric_limits<T>::quiet_NaN();
+				return in + 4;
+			}
+		}
+		const auto result = std::from_chars(in, end, value);
+		return result.ec == std::errc() ? result.ptr : nullptr;
+	} else {
+		std::string_view str;
+		std::string scratch;
+		in = readString(str, scratch, in, end);
+		if(in) {
+			value = str;
+		}
+		return in;
+	}
+}
+
+// Returns just past the closing quote of a string opened before the input
+inline const char* skipString(const char* in, const char* end) {
+	for(;;) {
+		const auto quote = static_cast<const char*>(std::memchr(in, '"', end - in));
+		if(!quote) {
+			return nullptr;
+		}
+		auto backslashes = quote;
+		while(backslashes != in && backslashes[-1] == '\\') {
+			--backslashes;
+		}
+		if((quote - backslashes) % 2 == 0) {
+			return quote + 1;
+		}
+		in = quote + 1;
+	}
+}
+
+// Skips a value of any kind, only matching up quotes and counting brackets,
+// so that skipped values are not checked to be valid
+inline const char* skipValue(const char* in, const char* end) {
+	in = skipSpace(in, end);
+	if(!in || in == end) {
+		return nullptr;
+	}
+	if(*in == '"') {
+		return skipString(in + 1, end);
+	}
+	if(*in != '{' && *in != '[') {
+		const auto start = in;
+		while(in != end && *in != ',' && *in != '}' && *in != ']' && *in != ' ' && *in != '\n' && *in != '\r' && *in != '\t') {
+			++in;
+		}
+		return in != start ? in : nullptr;
+	}
+
+	size_t depth = 0;
+	while(in != end) {
+		switch(*in++) {
+			case '"':
+				in = skipString(in, end);
+				if(!in) {
+					return nullptr;
+				}
+				break;
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if(--depth == 0) {
+					return in;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return nullptr;
+}
+
+// Objects and arrays are read in a loop advancing to each key or element in
+// turn, which stops at the closing bracket or on invalid input, leaving the
+// input null
+inline bool nextKey(std::string_view& key, std::string& scratch, const char*& in, const char* end, bool first) {
+	in = skipSpace(in, end);
+	if(!in || in == end) {
+		in = nullptr;
+		return false;
+	}
+	if(*in == '}') {
+		++in;
+		return false;
+	}
+	if(!first) {
+		in = *in == ',' ? in + 1 : nullptr;
+	}
+	in = readString(key, scratch, in, end);
+	in = expect(':', in, end);
+	return in;
+}
+
+inline bool nextElement(const char*& in, const char* end, bool first) {
+	in = skipSpace(in, end);
+	if(!in || in == end) {
+		in = nullptr;
+		return false;
+	}
+	if(*in == ']') {
+		++in;
+		return false;
+	}
+	if(!first) {
+		in = *in == ',' ? in + 1 : nullptr;
+	}
+	return in;
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		writeMaxSize(symbols, struc, output);
+		writeEncoder(symbols, struc, output);
+		writeDecoder(symbols, struc, output);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 768 + struc.members.size() * 256;
+	}
+
+private:
+	// Same hash as written in the prelude
+	static uint32_t keyHash(std::string_view key, uint32_t seed) {
+		uint32_t hash = seed ^ static_cast<uint32_t>(key.size());
+		for(const char c : key) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 0x01000193u;
+		}
+		return hash ^ hash >> 15;
+	}
+
+	struct KeyTable {
+		uint32_t seed;
+		uint32_t mask;
+	};
+
+	// Searches for a seed placing every member name in a slot of its own,
+	// growing the table up to four times the smallest that could fit. Should
+	// none be found, every name shares one slot, where names are compared in
+	// turn
+	static KeyTable findKeyTable(const SymbolTable::Struct& struc) {
+		static constexpr uint32_t seeds = 256;
+		uint32_t slots = 1;
+		while(slots < struc.members.size()) {
+			slots <<= 1;
+		}
+		std::vector<bool> used;
+		for(const uint32_t largest = slots * 4; slots <= largest; slots <<= 1) {
+			for(uint32_t seed = 0; seed < seeds; seed++) {
+				used.assign(slots, false);
+				bool distinct = true;
+				for(const auto& member : struc.members) {
+					const auto slot = keyHash(member.node->name, seed) & (slots - 1);
+					if(used[slot]) {
+						distinct = false;
+						break;
+					}
+					used[slot] = true;
+				}
+				if(distinct) {
+					return {seed, slots - 1};
+				}
+			}
+		}
+		return {0, 0};
+	}
+
+	static bool isScalar(const SymbolTable::Type& type) {
+		return type.kind == SymbolTable::Kind::Signed || type.kind == SymbolTable::Kind::Unsigned
+			|| type.kind == SymbolTable::Kind::Float || type.kind == SymbolTable::Kind::Bool;
+	}
+
+	static std::string readValue(const SymbolTable::Type& type, const std::string& target) {
+		return (type.kind == SymbolTable::Kind::Struct ? "fromJson(" : "scv::json::read(") + target + ", in, end)";
+	}
+
+	static std::string writeValue(const SymbolTable::Type& type, const std::string& value) {
+		return (type.kind == SymbolTable::Kind::Struct ? "toJson(" : "scv::json::write(") + value + ", out, end)";
+	}
+
+	static std::string maxSizeOf(const SymbolTable::Type& type, const std::string& value) {
+		return (type.kind == SymbolTable::Kind::Struct ? "maxJsonSize(" : "scv::json::maxSize(") + value + ")";
+	}
+
+	// Keys and punctuation between members, as JSON and as a C++ literal
+	static std::string keyOf(const SymbolTable::Member& member, bool first) {
+		return (first ? "{\"" : ",\"") + std::string(member.node->name) + "\":";
+	}
+
+	static std::string literal(const std::string& text) {
+		std::string str = "\"";
+		for(const char c : text) {
+			if(c == '"' || c == '\\') {
+				str.push_back('\\');
+			}
+			str.push_back(c);
+		}
+		return str + "\", " + std::to_string(text.size());
+	}
+
+	// Bounds the size of the encoded value, so that a buffer can be sized
+	// once before encoding
+	void writeMaxSize(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		size_t fixed = struc.members.empty() ? 2 : 1;
+		std::string str;
+		for(size_t i = 0; i < struc.members.size(); i++) {
+			const auto& member = struc.members[i];
+			const auto& memberType = symbols.types[member.type];
+			const std::string value = "value." + std::string(member.node->name);
+			fixed += keyOf(member, i == 0).size();
+			if(memberType.element == SymbolTable::none) {
+				str.append("\tsize += " + maxSizeOf(memberType, value) + ";\n");
+				continue;
+			}
+			const auto& element = symbols.types[memberType.element];
+			fixed += 2;
+			if(isScalar(element)) {
+				str.append("\tsize += " + value + ".size() * (1 + scv::json::maxScalarSize<" + std::string(element.spelling) + ">());\n");
+			} else {
+				str.append("\tfor(const auto& element : " + value + ") {\n");
+				str.append("\t\tsize += 1 + " + maxSizeOf(element, "element") + ";\n\t}\n");
+			}
+		}
+
+		output.append("inline size_t maxJsonSize(const " + type + (str.empty() ? "&) {\n" : "& value) {\n"));
+		if(str.empty()) {
+			output.append("\treturn " + std::to_string(fixed) + ";\n}\n\n");
+			return;
+		}
+		output.append("\tsize_t size = " + std::to_string(fixed) + ";\n");
+		output.append(str);
+		output.append("\treturn size;\n}\n\n");
+	}
+
+	// Keys are known when generating, so the punctuation and keys between
+	// two values are written as one literal
+	void writeEncoder(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		std::string str;
+		std::string pending;
+		const auto flush = [&]() {
+			str.append("\tout = scv::json::writeRaw(" + literal(pending) + ", out, end);\n");
+			pending.clear();
+		};
+		for(size_t i = 0; i < struc.members.size(); i++) {
+			const auto& member = struc.members[i];
+			const auto& memberType = symbols.types[member.type];
+			const std::string value = "value." + std::string(member.node->name);
+			pending.append(keyOf(member, i == 0));
+			if(memberType.element == SymbolTable::none) {
+				flush();
+				str.append("\tout = " + writeValue(memberType, value) + ";\n");
+				continue;
+			}
+			pending.append("[");
+			flush();
+			str.append("\tfor(size_t i = 0; i < " + value + ".size(); i++) {\n");
+			str.append("\t\tout = i > 0 ? scv::json::writeRaw(\",\", 1, out, end) : out;\n");
+			str.append("\t\tout = " + writeValue(symbols.types[memberType.element], value + "[i]") + ";\n\t}\n");
+			pending.append("]");
+		}
+		pending.append(struc.members.empty() ? "{}" : "}");
+
+		output.append("// Returns the end of what was written, or null if the buffer is too small\n");
+		output.append("inline char* toJson(const " + type + (str.empty() ? "&, char* out, char* end) {\n" : "& value, char* out, char* end) {\n"));
+		output.append(str);
+		output.append("\treturn scv::json::writeRaw(" + literal(pending) + ", out, end);\n}\n\n");
+	}
+
+	// Members missing from the object keep their values. Arrays must hold
+	// exactly as many elements as their member
+	void writeDecoder(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const {
+		const std::string type(struc.node->name);
+		const auto table = findKeyTable(struc);
+		std::vector<std::vector<size_t>> slots(static_cast<size_t>(table.mask) + 1);
+		for(size_t i = 0; i < struc.members.size(); i++) {
+			slots[keyHash(struc.members[i].node->name, table.seed) & table.mask].push_back(i);
+		}
+
+		std::string str;
+		const bool dispatched = slots.size() > 1;
+		const std::string indent = dispatched ? "\t\t\t\t" : "\t\t";
+		if(dispatched) {
+			str.append("\t\tswitch(scv::json::keyHash(key.data(), key.size(), " + std::to_string(table.seed) + "u) & " + std::to_string(table.mask) + "u) {\n");
+		}
+		for(size_t slot = 0; slot < slots.size(); slot++) {
+			if(slots[slot].empty()) {
+				continue;
+			}
+			if(dispatched) {
+				str.append("\t\t\tcase " + std::to_string(slot) + ":\n");
+			}
+			for(const auto i : slots[slot]) {
+				const auto& member = struc.members[i];
+				const auto& memberType = symbols.types[member.type];
+				const std::string value = "value." + std::string(member.node->name);
+				str.append(indent + "if(key == \"" + std::string(member.node->name) + "\") {\n");
+				if(memberType.element == SymbolTable::none) {
+					str.append(indent + "\tin = " + readValue(memberType, value) + ";\n");
+				} else {
+					writeElements(symbols, memberType, value, indent + "\t", str);
+				}
+				str.append(indent + "\tcontinue;\n" + indent + "}\n");
+			}
+			if(dispatched) {
+				str.append("\t\t\t\tbreak;\n");
+			}
+		}
+		if(dispatched) {
+			str.append("\t\t}\n");
+		}
+
+		output.append("// Returns the end of the object read, or null if the input does not hold one\n");
+		output.append("inline const char* fromJson(" + type + (str.empty() ? "&, const char* in, const char* end) {\n" : "& value, const char* in, const char* end) {\n"));
+		output.append("\tstd::string_view key;\n\tstd::string scratch;\n");
+		output.append("\tin = scv::json::expect('{', in, end);\n");
+		output.append("\tfor(bool first = true; scv::json::nextKey(key, scratch, in, end, first); first = false) {\n");
+		output.append(str);
+		output.append("\t\tin = scv::json::skipValue(in, end);\n\t}\n\treturn in;\n}\n\n");
+	}
+
+	static void writeElements(const SymbolTable& symbols, const SymbolTable::Type& type, const std::string& value, const std::string& indent, std::string& str) {
+		const auto& element = symbols.types[type.element];
+		const bool sequence = type.kind == SymbolTable::Kind::Sequence;
+		const auto count = std::to_string(type.count);
+		if(sequence) {
+			str.append(indent + value + ".clear();\n");
+		} else {
+			str.append(indent + "size_t count = 0;\n");
+		}
+		str.append(indent + "in = scv::json::expect('[', in, end);\n");
+		str.append(indent + "for(bool first = true; scv::json::nextElement(in, end, first); first = false) {\n");
+		if(sequence) {
+			str.append(indent + "\tin = " + readValue(element, value + ".emplace_back()") + ";\n");
+		} else {
+			str.append(indent + "\tif(count == " + count + ") {\n" + indent + "\t\treturn nullptr;\n" + indent + "\t}\n");
+			str.append(indent + "\tin = " + readValue(element, value + "[count++]") + ";\n");
+		}
+		str.append(indent + "}\n");
+		if(!sequence) {
+			str.append(indent + "if(count != " + count + ") {\n" + indent + "\treturn nullptr;\n" + indent + "}\n");
+		}
+	}
+};
+
+}
+
+const Builtin& jsonBuiltin() {
+	static const JsonBuiltin builtin;
+	return builtin;
+}
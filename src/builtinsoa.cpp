@@ -0,0 +1,224 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+// A companion <Type>SoA holding one column per member in declaration order,
+// with proxy references standing in for elements. Nested structs are kept
+// whole in their column
+class SoaBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "SoA";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<cstddef>", "<cstdint>", "<memory>", "<utility>", "<vector>"};
+		return requirements;
+	}
+
+	bool check(const SymbolTable&, const SymbolTable::Struct& struc) const override {
+		constexpr std::string_view reserved[] = {
+			"size", "empty", "reserve", "clear", "push_back", "from", "toVector", "Reference", "ConstReference",
+		};
+
+		if(struc.members.empty()) {
+			error::onToken("SoA requires at least one member", *struc.node->origin);
+			return false;
+		}
+		for(const auto& member : struc.members) {
+			if(std::find(std::begin(reserved), std::end(reserved), member.node->name) != std::end(reserved)) {
+				error::onToken("Member '" + std::string(member.node->name) + "' clashes with a function of SoA", *member.node->nameToken);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_SOA_PRELUDE
+#define SCV_SOA_PRELUDE
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+namespace scv::soa {
+
+// Contiguous storage which, unlike std::vector<bool>, can always hand out
+// references to single elements
+template<typename T>
+class Column {
+public:
+	Column() = default;
+	Column(Column&&) noexcept = default;
+	Column& operator=(Column&&) noexcept = default;
+
+	Column(const Column& other) {
+		*this = other;
+	}
+
+	Column& operator=(const Column& other) {
+		if(this != &other) {
+			clear();
+			reserve(other.count);
+			for(const auto& value : other) {
+				push_back(value);
+			}
+		}
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return allocated; }
+	bool empty() const { return count == 0; }
+	T* data() { return values.get(); }
+	const T* data() const { return values.get(); }
+	T* begin() { return data(); }
+	T* end() { return data() + count; }
+	const T* begin() const { return data(); }
+	const T* end() const { return data() + count; }
+	T& operator[](size_t i) { return values[i]; }
+	const T& operator[](size_t i) const { return values[i]; }
+
+#if __cplusplus >= 202002L
+	std::span<T> span() { return {data(), count}; }
+	std::span<const T> span() const { return {data(), count}; }
+#endif
+
+	void reserve(size_t n) {
+		if(n <= allocated) {
+			return;
+		}
+		std::unique_ptr<T[]> grown(new T[n]);
+		for(size_t i = 0; i < count; i++) {
+			grown[i] = std::move(values[i]);
+		}
+		values = std::move(grown);
+		allocated = n;
+	}
+
+	void push_back(const T& value) {
+		if(count == allocated) {
+			reserve(allocated ? allocated * 2 : 16);
+		}
+		values[count++] = value;
+	}
+
+	void clear() {
+		for(size_t i = 0; i < count; i++) {
+			values[i] = T();
+		}
+		count = 0;
+	}
+
+private:
+	std::unique_ptr<T[]> values;
+	size_t count = 0;
+	size_t allocated = 0;
+};
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const std::string type(struc.node->name);
+		const std::string soa = type + "SoA";
+		const auto first = "this->" + std::string(struc.members.front().node->name);
+
+		std::string str;
+		str.append("struct " + soa + " {\n");
+		for(const auto& member : struc.members) {
+			str.append("\tscv::soa::Column<");
+			str.append(symbols.types[member.type].spelling);
+			str.append("> ").append(member.node->name).append(";\n");
+		}
+
+		writeReference(symbols, struc, "Reference", "", str);
+		writeReference(symbols, struc, "ConstReference", "const ", str);
+
+		str.append("\n\tsize_t size() const {\n\t\treturn " + first + ".size();\n\t}\n\n");
+		str.append("\tbool empty() const {\n\t\treturn " + first + ".empty();\n\t}\n\n");
+		str.append("\tvoid reserve(size_t n) {\n");
+		forEachMember(struc, "\t\tthis->", ".reserve(n);\n", str);
+		str.append("\t}\n\n\tvoid clear() {\n");
+		forEachMember(struc, "\t\tthis->", ".clear();\n", str);
+		str.append("\t}\n\n\tvoid push_back(const " + type + "& value) {\n");
+		for(const auto& member : struc.members) {
+			str.append("\t\tthis->").append(member.node->name).append(".push_back(value.");
+			str.append(member.node->name).append(");\n");
+		}
+		str.append("\t}\n\n");
+
+		str.append("\tReference operator[](size_t i) {\n\t\treturn Reference{");
+		forEachMember(struc, "this->", "[i], ", str);
+		str.resize(str.size() - 2);
+		str.append("};\n\t}\n\n");
+		str.append("\tConstReference operator[](size_t i) const {\n\t\treturn ConstReference{");
+		forEachMember(struc, "this->", "[i], ", str);
+		str.resize(str.size() - 2);
+		str.append("};\n\t}\n\n");
+
+		str.append("\tstatic " + soa + " from(const std::vector<" + type + ">& values) {\n");
+		str.append("\t\t" + soa + " soa;\n\t\tsoa.reserve(values.size());\n");
+		str.append("\t\tfor(const auto& value : values) {\n\t\t\tsoa.push_back(value);\n\t\t}\n");
+		str.append("\t\treturn soa;\n\t}\n\n");
+
+		str.append("\tstd::vector<" + type + "> toVector() const {\n");
+		str.append("\t\tstd::vector<" + type + "> values;\n\t\tvalues.reserve(size());\n");
+		str.append("\t\tfor(size_t i = 0; i < size(); i++) {\n\t\t\tvalues.push_back((*this)[i]);\n\t\t}\n");
+		str.append("\t\treturn values;\n\t}\n};\n\n");
+
+		output.append(str);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 1024 + struc.members.size() * 320;
+	}
+
+private:
+	static void forEachMember(const SymbolTable::Struct& struc, std::string_view before, std::string_view after, std::string& str) {
+		for(const auto& member : struc.members) {
+			str.append(before).append(member.node->name).append(after);
+		}
+	}
+
+	// Converts to and assigns from the struct itself
+	static void writeReference(const SymbolTable& symbols, const SymbolTable::Struct& struc, std::string_view name, std::string_view qualifier, std::string& str) {
+		const auto type = struc.node->name;
+		str.append("\n\tstruct ").append(name).append(" {\n");
+		for(const auto& member : struc.members) {
+			str.append("\t\t").append(qualifier).append(symbols.types[member.type].spelling);
+			str.append("& ").append(member.node->name).append(";\n");
+		}
+
+		str.append("\n\t\toperator ").append(type).append("() const {\n\t\t\t").append(type).append(" value;\n");
+		for(const auto& member : struc.members) {
+			str.append("\t\t\tvalue.").append(member.node->name).append(" = this->");
+			str.append(member.node->name).append(";\n");
+		}
+		str.append("\t\t\treturn value;\n\t\t}\n");
+
+		if(qualifier.empty()) {
+			str.append("\n\t\t").append(name).append("& operator=(const ").append(type).append("& value) {\n");
+			for(const auto& member : struc.members) {
+				str.append("\t\t\tthis->").append(member.node->name).append(" = value.");
+				str.append(member.node->name).append(";\n");
+			}
+			str.append("\t\t\treturn *this;\n\t\t}\n");
+		}
+		str.append("\t};\n");
+	}
+};
+
+}
+
+const Builtin& soaBuiltin() {
+	static const SoaBuiltin builtin;
+	return builtin;
+}
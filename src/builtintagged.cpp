@@ -0,0 +1,480 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+// Fields are written in order of their tags, each after a varint header
+// holding its tag and wire type. The wire type tells readers how long a
+// field is, so that fields they do not know of are skipped without being
+// parsed: fixed width fields by their size, strings, structs and arrays by
+// their length prefix
+class TaggedBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "Tagged";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<cstddef>", "<cstdint>", "<cstring>", "<limits>", "<string_view>", "<type_traits>"};
+		return requirements;
+	}
+
+	bool check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const override {
+		for(const auto& member : struc.members) {
+			if(member.node->tag == 0) {
+				const std::string name(member.node->name);
+				error::onToken("Member '" + name + "' needs a tag, as in '" + name + " = 1', to be written by Tagged", *member.node->nameToken);
+				return false;
+			}
+		}
+		return Builtin::check(symbols, struc);
+	}
+
+	bool usesVarints() const override {
+		return true;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_TAGGED_PRELUDE
+#define SCV_TAGGED_PRELUDE
+namespace scv::tagged {
+
+// Low three bits of a field header
+enum WireType : uint8_t {
+	Varint = 0,
+	Fixed1 = 1,
+	Fixed2 = 2,
+	Fixed4 = 3,
+	Fixed8 = 4,
+	Bytes = 5,
+};
+
+inline std::byte* writeRaw(const char* bytes, size_t size, std::byte* out) {
+	std::memcpy(out, bytes, size);
+	return out + size;
+}
+
+// Moves past the header when it is the one expected next
+inline bool next(const char* header, size_t size, const std::byte*& in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) < size || std::memcmp(in, header, size) != 0) {
+		return false;
+	}
+	in += size;
+	return true;
+}
+
+// Fixed width values are written as they lie in memory
+template<typename T>
+inline std::byte* writeFixed(const T& value, std::byte* out) {
+	std::memcpy(out, &value, sizeof(T));
+	return out + sizeof(T);
+}
+
+template<typename T>
+inline const std::byte* readFixed(T& value, const std::byte* in, const std::byte* end) {
+	if(!in || static_cast<size_t>(end - in) < sizeof(T)) {
+		return nullptr;
+	}
+	std::memcpy(&value, in, sizeof(T));
+	return in + sizeof(T);
+}
+
+inline const std::byte* readLength(const std::byte*& fieldEnd, const std::byte* in, const std::byte* end) {
+	uint64_t length = 0;
+	in = varint::read(length, in, end);
+	if(!in || length > static_cast<uint64_t>(end - in)) {
+		return nullptr;
+	}
+	fieldEnd = in + length;
+	return in;
+}
+
+template<typename String>
+inline size_t stringSize(const String& str) {
+	return varint::size(str.size()) + str.size();
+}
+
+template<typename String>
+inline std::byte* writeString(const String& str, std::byte* out) {
+	out = varint::write(str.size(), out);
+	std::memcpy(out, str.data(), str.size());
+	return out + str.size();
+}
+
+// Inline strings truncate strings longer than their capacity
+template<typename String>
+inline const std::byte* readString(String& str, const std::byte* in, const std::byte* end) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	if(!in) {
+		return nullptr;
+	}
+	str = std::string_view(reinterpret_cast<const char*>(in), fieldEnd - in);
+	return fieldEnd;
+}
+
+// Arrays and sequences of fixed width values are copied as one block
+template<typename T>
+inline size_t blockSize(const T*, size_t count) {
+	return varint::size(count * sizeof(T)) + count * sizeof(T);
+}
+
+template<typename T>
+inline std::byte* writeBlock(const T* values, size_t count, std::byte* out) {
+	out = varint::write(count * sizeof(T), out);
+	if(count > 0) {
+		std::memcpy(out, values, count * sizeof(T));
+	}
+	return out + count * sizeof(T);
+}
+
+template<typename T>
+inline const std::byte* readBlock(T* values, size_t count, const std::byte* in, const std::byte* end) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	if(!in || static_cast<size_t>(fieldEnd - in) != count * sizeof(T)) {
+		return nullptr;
+	}
+	if(count > 0) {
+		std::memcpy(values, in, count * sizeof(T));
+	}
+	return fieldEnd;
+}
+
+template<typename Sequence>
+inline const std::byte* readBlock(Sequence& values, const std::byte* in, const std::byte* end) {
+	using T = typename Sequence::value_type;
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	if(!in || static_cast<size_t>(fieldEnd - in) % sizeof(T) != 0) {
+		return nullptr;
+	}
+	values.resize(static_cast<size_t>(fieldEnd - in) / sizeof(T));
+	if(!values.empty()) {
+		std::memcpy(values.data(), in, values.size() * sizeof(T));
+	}
+	return fieldEnd;
+}
+
+template<typename String>
+inline size_t stringsSize(const String* strings, size_t count) {
+	size_t size = 0;
+	for(size_t i = 0; i < count; i++) {
+		size += stringSize(strings[i]);
+	}
+	return varint::size(size) + size;
+}
+
+template<typename String>
+inline std::byte* writeStrings(const String* strings, size_t count, std::byte* out) {
+	size_t size = 0;
+	for(size_t i = 0; i < count; i++) {
+		size += stringSize(strings[i]);
+	}
+	out = varint::write(size, out);
+	for(size_t i = 0; i < count; i++) {
+		out = writeString(strings[i], out);
+	}
+	return out;
+}
+
+template<typename String>
+inline const std::byte* readStrings(String* strings, size_t count, const std::byte* in, const std::byte* end) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	for(size_t i = 0; i < count && in; i++) {
+		in = readString(strings[i], in, fieldEnd);
+	}
+	return in == fieldEnd ? in : nullptr;
+}
+
+template<typename Sequence>
+inline const std::byte* readStrings(Sequence& strings, const std::byte* in, const std::byte* end) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	strings.clear();
+	while(in && in != fieldEnd) {
+		in = readString(strings.emplace_back(), in, fieldEnd);
+	}
+	return in;
+}
+
+// Structs are prefixed with their size, and take the functions sizing,
+// writing and reading them so that one template serves every struct
+template<typename T>
+inline size_t nestedSize(const T& value, size_t (*size)(const T&)) {
+	const size_t n = size(value);
+	return varint::size(n) + n;
+}
+
+template<typename T>
+inline std::byte* writeNested(const T& value, std::byte* out, size_t (*size)(const T&), std::byte* (*write)(const T&, std::byte*)) {
+	out = varint::write(size(value), out);
+	return write(value, out);
+}
+
+template<typename T>
+inline const std::byte* readNested(T& value, const std::byte* in, const std::byte* end, const std::byte* (*read)(T&, const std::byte*, const std::byte*)) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	return in && read(value, in, fieldEnd) == fieldEnd ? fieldEnd : nullptr;
+}
+
+template<typename T>
+inline size_t nestedValuesSize(const T* values, size_t count, size_t (*size)(const T&)) {
+	size_t n = 0;
+	for(size_t i = 0; i < count; i++) {
+		n += nestedSize(values[i], size);
+	}
+	return varint::size(n) + n;
+}
+
+template<typename T>
+inline std::byte* writeNestedValues(const T* values, size_t count, std::byte* out, size_t (*size)(const T&), std::byte* (*write)(const T&, std::byte*)) {
+	size_t n = 0;
+	for(size_t i = 0; i < count; i++) {
+		n += nestedSize(values[i], size);
+	}
+	out = varint::write(n, out);
+	for(size_t i = 0; i < count; i++) {
+		out = writeNested(values[i], out, size, write);
+	}
+	return out;
+}
+
+template<typename T>
+inline const std::byte* readNestedValues(T* values, size_t count, const std::byte* in, const std::byte* end, const std::byte* (*read)(T&, const std::byte*, const std::byte*)) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	for(size_t i = 0; i < count && in; i++) {
+		in = readNested(values[i], in, fieldEnd, read);
+	}
+	return in == fieldEnd ? in : nullptr;
+}
+
+template<typename Sequence>
+inline const std::byte* readNestedValues(Sequence& values, const std::byte* in, const std::byte* end,
+	const std::byte* (*read)(typename Sequence::value_type&, const std::byte*, const std::byte*)) {
+	const std::byte* fieldEnd = nullptr;
+	in = readLength(fieldEnd, in, end);
+	values.clear();
+	while(in && in != fieldEnd) {
+		in = readNested(values.emplace_back(), in, fieldEnd, read);
+	}
+	return in;
+}
+
+// Skips a field of any tag, given its header
+inline const std::byte* skip(uint64_t header, const std::byte* in, const std::byte* end) {
+	static constexpr size_t sizes[] = {0, 1, 2, 4, 8};
+	const auto wireType = header & 7;
+	if(wireType == Varint) {
+		uint64_t value;
+		return varint::read(value, in, end);
+	} else if(wireType == Bytes) {
+		const std::byte* fieldEnd = nullptr;
+		return readLength(fieldEnd, in, end) ? fieldEnd : nullptr;
+	} else if(wireType < Bytes && in && static_cast<size_t>(end - in) >= sizes[wireType]) {
+		return in + sizes[wireType];
+	}
+	return nullptr;
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		std::vector<Field> fields;
+		fields.reserve(struc.members.size());
+		for(const auto& member : struc.members) {
+			fields.push_back(fieldOf(symbols, member));
+		}
+		std::sort(fields.begin(), fields.end(), [](const Field& lhs, const Field& rhs) {
+			return lhs.member->node->tag < rhs.member->node->tag;
+		});
+		writeSize(struc, fields, output);
+		writeEncoder(struc, fields, output);
+		writeDecoder(struc, fields, output);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 1024 + struc.members.size() * 384;
+	}
+
+private:
+	enum class WireType : uint8_t {
+		Varint = 0,
+		Fixed1 = 1,
+		Fixed2 = 2,
+		Fixed4 = 3,
+		Fixed8 = 4,
+		Bytes = 5,
+	};
+
+	// How a member is sized, written and read, as expressions on its value.
+	// Fields of constant size have no expression sizing them
+	struct Field {
+		const SymbolTable::Member* member;
+		WireType wireType;
+		uint32_t fixedSize;
+		std::string size;
+		std::string write;
+		std::string read;
+	};
+
+	// Integers are varints, with signed ones zigzag encoded, whether or not
+	// the struct is varint, unless their members say otherwise
+	static SymbolTable::Encoding encodingOf(const SymbolTable& symbols, const SymbolTable::Member& member) {
+		const auto kind = symbols.types[member.type].kind;
+		if(!member.node->options.empty()) {
+			return member.encoding;
+		} else if(kind == SymbolTable::Kind::Signed) {
+			return SymbolTable::Encoding::Zigzag;
+		} else if(kind == SymbolTable::Kind::Unsigned) {
+			return SymbolTable::Encoding::Varint;
+		}
+		return SymbolTable::Encoding::Fixed;
+	}
+
+	static Field fieldOf(const SymbolTable& symbols, const SymbolTable::Member& member) {
+		const auto& type = symbols.types[member.type];
+		const std::string value = "value." + std::string(member.node->name);
+		const std::string values = value + ".data(), " + value + ".size()";
+		const bool sequence = type.kind == SymbolTable::Kind::Sequence;
+		Field field{&member, WireType::Bytes, 0, "", "", ""};
+		if(type.element != SymbolTable::none) {
+			const auto& element = symbols.types[type.element];
+			const std::string target = sequence ? value : values;
+			if(element.fixedWidth()) {
+				field.size = "scv::tagged::blockSize(" + values + ")";
+				field.write = "scv::tagged::writeBlock(" + values + ", out)";
+				field.read = "scv::tagged::readBlock(" + target + ", in, end)";
+			} else if(element.kind == SymbolTable::Kind::Struct) {
+				field.size = "scv::tagged::nestedValuesSize(" + values + ", taggedSize)";
+				field.write = "scv::tagged::writeNestedValues(" + values + ", out, taggedSize, writeTagged)";
+				field.read = "scv::tagged::readNestedValues(" + target + ", in, end, readTagged)";
+			} else {
+				field.size = "scv::tagged::stringsSize(" + values + ")";
+				field.write = "scv::tagged::writeStrings(" + values + ", out)";
+				field.read = "scv::tagged::readStrings(" + target + ", in, end)";
+			}
+		} else if(type.kind == SymbolTable::Kind::Struct) {
+			field.size = "scv::tagged::nestedSize(" + value + ", taggedSize)";
+			field.write = "scv::tagged::writeNested(" + value + ", out, taggedSize, writeTagged)";
+			field.read = "scv::tagged::readNested(" + value + ", in, end, readTagged)";
+		} else if(type.kind == SymbolTable::Kind::String || type.kind == SymbolTable::Kind::InlineString) {
+			field.size = "scv::tagged::stringSize(" + value + ")";
+			field.write = "scv::tagged::writeString(" + value + ", out)";
+			field.read = "scv::tagged::readString(" + value + ", in, end)";
+		} else if(const auto encoding = encodingOf(symbols, member); encoding != SymbolTable::Encoding::Fixed) {
+			const std::string zigzag = encoding == SymbolTable::Encoding::Zigzag ? "true" : "false";
+			field.wireType = WireType::Varint;
+			field.size = "scv::varint::size(scv::varint::encode<" + zigzag + ">(" + value + "))";
+			field.write = "scv::varint::write(scv::varint::encode<" + zigzag + ">(" + value + "), out)";
+			field.read = "scv::varint::read<" + zigzag + ">(" + value + ", in, end)";
+		} else {
+			field.wireType = type.size == 1 ? WireType::Fixed1 : type.size == 2 ? WireType::Fixed2 : type.size == 4 ? WireType::Fixed4 : WireType::Fixed8;
+			field.fixedSize = type.size;
+			field.write = "scv::tagged::writeFixed(" + value + ", out)";
+			field.read = "scv::tagged::readFixed(" + value + ", in, end)";
+		}
+		return field;
+	}
+
+	static uint64_t headerOf(const Field& field) {
+		return static_cast<uint64_t>(field.member->node->tag) << 3 | static_cast<uint64_t>(field.wireType);
+	}
+
+	// The header as a varint, spelled as a string literal followed by its size
+	static std::string headerBytes(const Field& field) {
+		static constexpr char hex[] = "0123456789abcdef";
+		std::string str = "\"";
+		size_t size = 0;
+		uint64_t header = headerOf(field);
+		do {
+			const auto byte = static_cast<unsigned>((header & 0x7f) | (header >= 0x80 ? 0x80 : 0));
+			str.append("\\x").append(1, hex[byte >> 4]).append(1, hex[byte & 0xf]);
+			header >>= 7;
+			++size;
+		} while(header > 0);
+		return str + "\", " + std::to_string(size);
+	}
+
+	static size_t headerSize(const Field& field) {
+		size_t size = 1;
+		for(uint64_t header = headerOf(field); header >= 0x80; header >>= 7) {
+			++size;
+		}
+		return size;
+	}
+
+	void writeSize(const SymbolTable::Struct& struc, const std::vector<Field>& fields, OutputWriter& output) const {
+		size_t fixed = 0;
+		std::string variable;
+		for(const auto& field : fields) {
+			fixed += headerSize(field) + field.fixedSize;
+			if(!field.size.empty()) {
+				variable.append("\n\t\t+ " + field.size);
+			}
+		}
+		output.append("inline size_t taggedSize(const " + std::string(struc.node->name) + (variable.empty() ? "&) {\n" : "& value) {\n"));
+		output.append("\treturn " + std::to_string(fixed) + variable + ";\n}\n\n");
+	}
+
+	void writeEncoder(const SymbolTable::Struct& struc, const std::vector<Field>& fields, OutputWriter& output) const {
+		output.append("inline std::byte* writeTagged(const " + std::string(struc.node->name) + (fields.empty() ? "&, std::byte* out) {\n" : "& value, std::byte* out) {\n"));
+		for(const auto& field : fields) {
+			output.append("\tout = scv::tagged::writeRaw(" + headerBytes(field) + ", out);\n");
+			output.append("\tout = " + field.write + ";\n");
+		}
+		output.append("\treturn out;\n}\n\n");
+	}
+
+	// Fields written in order of their tags by the same version of the
+	// struct are read one after another, for as long as each header is the
+	// one expected next. Any fields left are dispatched on their tag, and
+	// read only when their wire type is the one expected
+	void writeDecoder(const SymbolTable::Struct& struc, const std::vector<Field>& fields, OutputWriter& output) const {
+		std::string str;
+		str.append("// Returns the end of what was read, or null if the input is malformed. Fields\n");
+		str.append("// missing from the input keep their values, and unknown fields are skipped\n");
+		str.append("inline const std::byte* readTagged(" + std::string(struc.node->name));
+		str.append(fields.empty() ? "&, const std::byte* in, const std::byte* end) {\n" : "& value, const std::byte* in, const std::byte* end) {\n");
+		for(size_t i = 0; i < fields.size(); i++) {
+			str.append(i == 0 ? "\tbool ordered = " : "\tordered = ordered && ");
+			str.append("scv::tagged::next(" + headerBytes(fields[i]) + ", in, end);\n");
+			str.append("\tif(ordered) {\n\t\tin = " + fields[i].read + ";\n\t}\n");
+		}
+
+		str.append("\twhile(in && in != end) {\n");
+		str.append("\t\tuint64_t header = 0;\n");
+		str.append("\t\tin = scv::varint::read(header, in, end);\n");
+		if(fields.empty()) {
+			str.append("\t\tin = scv::tagged::skip(header, in, end);\n");
+		} else {
+			str.append("\t\tswitch(header >> 3) {\n");
+			for(const auto& field : fields) {
+				str.append("\t\t\tcase " + std::to_string(field.member->node->tag) + ":\n");
+				str.append("\t\t\t\tin = header == " + std::to_string(headerOf(field)) + " ? " + field.read + " : scv::tagged::skip(header, in, end);\n");
+				str.append("\t\t\t\tbreak;\n");
+			}
+			str.append("\t\t\tdefault:\n\t\t\t\tin = scv::tagged::skip(header, in, end);\n\t\t\t\tbreak;\n\t\t}\n");
+		}
+		str.append("\t}\n\treturn in;\n}\n\n");
+		output.append(str);
+	}
+};
+
+}
+
+const Builtin& taggedBuiltin() {
+	static const TaggedBuiltin builtin;
+	return builtin;
+}
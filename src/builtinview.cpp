@@ -0,0 +1,294 @@
+#include "builtin.hpp"
+
+#include "error.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+// A read only <Type>View over bytes written by the Binary trait. Building
+// the view checks once that the bytes hold a whole value, recording where
+// every member of variable size ends, so that accessors take constant time
+class ViewBuiltin : public Builtin {
+public:
+	std::string_view name() const override {
+		return "View";
+	}
+
+	Span<const std::string_view> requirements() const override {
+		static constexpr std::string_view requirements[] = {"<cstddef>", "<cstdint>", "<cstring>", "<limits>", "<string_view>", "<type_traits>"};
+		return requirements;
+	}
+
+	bool check(const SymbolTable& symbols, const SymbolTable::Struct& struc) const override {
+		constexpr std::string_view reserved[] = {
+			"data", "length", "ends", "nested", "size", "valid",
+		};
+
+		if(!Builtin::check(symbols, struc)) {
+			return false;
+		}
+		if(!symbols.implements(symbols.types[struc.type].structId, symbols.findTrait("Binary"))) {
+			error::onToken("View reads what Binary writes, so '" + std::string(struc.node->name) + "' must implement Binary too", *struc.node->origin);
+			return false;
+		}
+		for(const auto& member : struc.members) {
+			if(std::find(std::begin(reserved), std::end(reserved), member.node->name) != std::end(reserved)) {
+				error::onToken("Member '" + std::string(member.node->name) + "' clashes with a function of View", *member.node->nameToken);
+				return false;
+			}
+			const auto& type = symbols.types[member.type];
+			if(type.element != SymbolTable::none && !symbols.types[type.element].fixedWidth()) {
+				error::onToken("Member '" + std::string(member.node->name) + "' holds values of variable size, which View cannot index", *member.node->nameToken);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void writePrelude(OutputWriter& output) const override {
+		output.append(R"(#ifndef SCV_VIEW_PRELUDE
+#define SCV_VIEW_PRELUDE
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+namespace scv::view {
+
+// Bytes in a buffer are not aligned for the type read from them
+template<typename T>
+inline T load(const std::byte* ptr) {
+	T value;
+	std::memcpy(&value, ptr, sizeof(T));
+	return value;
+}
+
+inline std::string_view string(const std::byte* ptr) {
+	return {reinterpret_cast<const char*>(ptr + sizeof(uint32_t)), load<uint32_t>(ptr)};
+}
+
+// Inline strings are a length byte followed by their capacity in bytes
+inline std::string_view inlineString(const std::byte* ptr, size_t capacity) {
+	const size_t length = static_cast<uint8_t>(ptr[0]);
+	return {reinterpret_cast<const char*>(ptr + 1), length < capacity ? length : capacity};
+}
+
+inline bool skipString(const std::byte* data, size_t size, size_t& at) {
+	if(size - at < sizeof(uint32_t)) {
+		return false;
+	}
+	const size_t length = load<uint32_t>(data + at);
+	at += sizeof(uint32_t);
+	if(size - at < length) {
+		return false;
+	}
+	at += length;
+	return true;
+}
+
+// Elements of a sequence, read on access
+template<typename T>
+class Sequence {
+public:
+	Sequence(const std::byte* ptr) : first(ptr + sizeof(uint32_t)), count(load<uint32_t>(ptr)) {}
+
+	size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	T operator[](size_t i) const {
+		return load<T>(first + i * sizeof(T));
+	}
+private:
+	const std::byte* first;
+	size_t count;
+};
+
+inline bool skipSequence(const std::byte* data, size_t size, size_t& at, size_t bytesPerElement) {
+	if(size - at < sizeof(uint32_t)) {
+		return false;
+	}
+	const size_t count = load<uint32_t>(data + at);
+	at += sizeof(uint32_t);
+	if((size - at) / bytesPerElement < count) {
+		return false;
+	}
+	at += count * bytesPerElement;
+	return true;
+}
+
+// Varints are only decoded once the view has checked that they end in time
+inline uint64_t varint(const std::byte* ptr) {
+	uint64_t value = 0;
+	for(unsigned shift = 0; ; shift += 7) {
+		const auto byte = static_cast<uint64_t>(*ptr++);
+		value |= (byte & 0x7f) << shift;
+		if(byte < 0x80) {
+			return value;
+		}
+	}
+}
+
+template<typename T, bool Zigzag>
+inline T varint(const std::byte* ptr) {
+	const uint64_t raw = varint(ptr);
+	if constexpr(std::is_signed_v<T>) {
+		return static_cast<T>(Zigzag
+			? static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1)
+			: static_cast<int64_t>(raw));
+	} else {
+		return static_cast<T>(raw);
+	}
+}
+
+// Fails on varints running past the end or out of range of their member
+template<typename T, bool Zigzag>
+inline bool skipVarint(const std::byte* data, size_t size, size_t& at) {
+	const size_t first = at;
+	while(at < size && at - first < 10) {
+		if(static_cast<uint8_t>(data[at++]) < 0x80) {
+			const uint64_t raw = varint(data + first);
+			if constexpr(std::is_signed_v<T>) {
+				const auto wide = Zigzag
+					? static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1)
+					: static_cast<int64_t>(raw);
+				return wide >= std::numeric_limits<T>::min() && wide <= std::numeric_limits<T>::max();
+			} else {
+				return raw <= std::numeric_limits<T>::max();
+			}
+		}
+	}
+	return false;
+}
+
+}
+#endif
+
+)");
+	}
+
+	void write(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output) const override {
+		const std::string view = std::string(struc.node->name) + "View";
+
+		// Where each member starts, as the number of the variable sized member
+		// before it, if any, and the bytes past the end of that member
+		size_t nVariable = 0;
+		std::string constructor;
+		std::string accessors;
+		std::string nested;
+		size_t fixed = 0;
+		for(size_t i = 0; i < struc.layout.size(); i++) {
+			const auto& member = symbols.memberAt(struc, i);
+			const auto& type = symbols.types[member.type];
+			const auto name = member.node->name;
+			std::string start = "data";
+			if(nVariable > 0) {
+				start.append(" + ends[" + std::to_string(nVariable - 1) + "]");
+			}
+			if(fixed > 0) {
+				start.append(" + " + std::to_string(fixed));
+			}
+
+			accessors.append("\t");
+			if(member.encoding != SymbolTable::Encoding::Fixed) {
+				const auto zigzagged = member.encoding == SymbolTable::Encoding::Zigzag ? "true" : "false";
+				accessors.append(type.spelling).append(" ").append(name).append("() const {\n");
+				accessors.append("\t\treturn scv::view::varint<").append(type.spelling).append(", ");
+				accessors.append(zigzagged).append(">(" + start + ");\n");
+				writeFixedCheck(fixed, constructor);
+				constructor.append("\t\tif(!scv::view::skipVarint<").append(type.spelling).append(", ");
+				constructor.append(zigzagged).append(">(data, size, at)) {\n\t\t\treturn;\n\t\t}\n");
+				constructor.append("\t\tends[" + std::to_string(nVariable++) + "] = at;\n");
+				fixed = 0;
+			} else if(type.kind == SymbolTable::Kind::Sequence) {
+				const auto& element = symbols.types[type.element];
+				accessors.append("scv::view::Sequence<").append(element.spelling).append("> ").append(name).append("() const {\n");
+				accessors.append("\t\treturn scv::view::Sequence<").append(element.spelling).append(">(" + start + ");\n");
+				writeFixedCheck(fixed, constructor);
+				constructor.append("\t\tif(!scv::view::skipSequence(data, size, at, " + std::to_string(element.size) + ")) {\n\t\t\treturn;\n\t\t}\n");
+				constructor.append("\t\tends[" + std::to_string(nVariable++) + "] = at;\n");
+				fixed = 0;
+			} else if(type.kind == SymbolTable::Kind::InlineString) {
+				accessors.append("std::string_view ").append(name).append("() const {\n");
+				accessors.append("\t\treturn scv::view::inlineString(" + start + ", " + std::to_string(type.size - 1) + ");\n");
+				fixed += type.size;
+			} else if(type.fixedWidth()) {
+				accessors.append(type.spelling).append(" ").append(name).append("() const {\n");
+				accessors.append("\t\treturn scv::view::load<").append(type.spelling).append(">(" + start + ");\n");
+				fixed += type.size;
+			} else if(type.kind == SymbolTable::Kind::String) {
+				accessors.append("std::string_view ").append(name).append("() const {\n");
+				accessors.append("\t\treturn scv::view::string(" + start + ");\n");
+				writeFixedCheck(fixed, constructor);
+				constructor.append("\t\tif(!scv::view::skipString(data, size, at)) {\n\t\t\treturn;\n\t\t}\n");
+				constructor.append("\t\tends[" + std::to_string(nVariable++) + "] = at;\n");
+				fixed = 0;
+			} else {
+				const std::string nestedView = std::string(type.name) + "View";
+				accessors.append("const ").append(nestedView).append("& ").append(name).append("() const {\n");
+				accessors.append("\t\treturn nested.").append(name).append(";\n");
+				nested.append("\t\t").append(nestedView).append(" ").append(name).append(";\n");
+				writeFixedCheck(fixed, constructor);
+				constructor.append("\t\tnested.").append(name).append(" = ").append(nestedView).append("(data + at, size - at);\n");
+				constructor.append("\t\tif(!nested.").append(name).append(".valid()) {\n\t\t\treturn;\n\t\t}\n");
+				constructor.append("\t\tat += nested.").append(name).append(".size();\n");
+				constructor.append("\t\tends[" + std::to_string(nVariable++) + "] = at;\n");
+				fixed = 0;
+			}
+			accessors.append("\t}\n\n");
+		}
+		writeFixedCheck(fixed, constructor);
+
+		std::string str;
+		str.append("class " + view + " {\npublic:\n");
+		str.append("\t" + view + "() = default;\n\n");
+		str.append("\t// Empty unless the bytes start with a whole value\n");
+		str.append("\t" + view + "(const std::byte* data, size_t" + (constructor.empty() ? ") {\n" : " size) {\n"));
+		str.append("\t\tsize_t at = 0;\n");
+		str.append(constructor);
+		str.append("\t\tthis->data = data;\n\t\tlength = at;\n\t}\n\n");
+		str.append("#if __cplusplus >= 202002L\n");
+		str.append("\texplicit " + view + "(std::span<const std::byte> bytes) : " + view + "(bytes.data(), bytes.size()) {}\n");
+		str.append("#endif\n\n");
+		str.append("\tbool valid() const {\n\t\treturn data != nullptr;\n\t}\n\n");
+		str.append("\t// Bytes taken up by the value\n");
+		str.append("\tsize_t size() const {\n\t\treturn length;\n\t}\n\n");
+		str.append(accessors);
+		str.append("private:\n");
+		str.append("\tconst std::byte* data = nullptr;\n\tsize_t length = 0;\n");
+		if(nVariable > 0) {
+			str.append("\tsize_t ends[" + std::to_string(nVariable) + "] = {};\n");
+		}
+		if(!nested.empty()) {
+			str.append("\tstruct {\n").append(nested).append("\t} nested;\n");
+		}
+		str.append("};\n\n");
+
+		output.append(str);
+	}
+
+	size_t estimateSize(const SymbolTable::Struct& struc) const override {
+		return 1024 + struc.members.size() * 256;
+	}
+
+private:
+	static void writeFixedCheck(size_t fixed, std::string& constructor) {
+		if(fixed == 0) {
+			return;
+		}
+		const auto bytes = std::to_string(fixed);
+		constructor.append("\t\tif(size - at < " + bytes + ") {\n\t\t\treturn;\n\t\t}\n");
+		constructor.append("\t\tat += " + bytes + ";\n");
+	}
+};
+
+}
+
+const Builtin& viewBuiltin() {
+	static const ViewBuiltin builtin;
+	return builtin;
+}
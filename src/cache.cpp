@@ -0,0 +1,108 @@
+#include "cache.hpp"
+
+#include "error.hpp"
+#include "hash.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+constexpr std::string_view header = "scv-manifest 2";
+constexpr size_t hexSize = 16;
+
+bool hashFile(const std::string& path, std::string& hex) {
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if(!file.is_open()) {
+		return false;
+	}
+	std::stringstream ss;
+	ss << file.rdbuf();
+
+	Hasher hasher;
+	hasher.update(ss.str());
+	hex = hasher.hex();
+	return true;
+}
+
+// Whether the line is an entry of the given kind naming a file which still
+// hashes to the recorded value
+bool matches(const std::string& line, std::string_view kind) {
+	if(line.compare(0, kind.size(), kind) != 0 || line.size() < kind.size() + hexSize + 2) {
+		return false;
+	}
+	std::string hex;
+	auto path = line.substr(kind.size() + hexSize + 1);
+	return hashFile(path, hex) && line.compare(kind.size(), hexSize, hex) == 0;
+}
+
+}
+
+namespace cache {
+
+bool upToDate(const std::string& manifest, const std::string& key) {
+	std::ifstream file(manifest);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	std::string line;
+	if(!std::getline(file, line) || line != header) {
+		return false;
+	}
+
+	if(!std::getline(file, line) || line != "key " + key) {
+		return false;
+	}
+
+	// output <hash> <path>, for every file written, then file <hash> <path>
+	// for every file read
+	size_t outputs = 0;
+	while(std::getline(file, line)) {
+		if(matches(line, "output ")) {
+			++outputs;
+		} else if(outputs == 0 || !matches(line, "file ")) {
+			return false;
+		}
+	}
+
+	return outputs > 0;
+}
+
+bool store(const std::string& manifest, const std::string& key, const std::vector<std::string>& outputs, const Sources& sources) {
+	std::ofstream file(manifest);
+	if(!file.is_open()) {
+		error::set("Cannot open file '" + manifest + "'\n");
+		return false;
+	}
+
+	file << header << '\n';
+	file << "key " << key << '\n';
+	std::string hex;
+	for(const auto& path : outputs) {
+		if(!hashFile(path, hex)) {
+			error::set("Cannot read output '" + path + "'\n");
+			return false;
+		}
+		file << "output " << hex << ' ' << path << '\n';
+	}
+	for(const auto& [path, src] : sources) {
+		Hasher hasher;
+		hasher.update(src);
+		file << "file " << hasher.hex() << ' ' << path << '\n';
+	}
+	return true;
+}
+
+std::string hashSources(const std::string& key, const Sources& sources) {
+	Hasher hasher;
+	hasher.update(key);
+	for(const auto& [path, src] : sources) {
+		hasher.update(path);
+		hasher.update(src.size());
+		hasher.update(src);
+	}
+	return hasher.hex();
+}
+
+}
@@ -1,375 +1,473 @@
 #include "emitter.hpp"
 
+#include "builtin.hpp"
 #include "error.hpp"
+#include "global.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 
-#include <fstream>
+#include <algorithm>
 #include <iostream>
 
-Emitter::Emitter(const RootAstNode& root, const std::string& path) : root(root), path(path), types(
-{
-	std::make_pair("int",    "int"),
-	std::make_pair("i8",     "int8_t"),
-	std::make_pair("i16",    "int16_t"),
-	std::make_pair("i32",    "int32_t"),
-	std::make_pair("i64",    "int64_t"),
-	std::make_pair("u8",     "uint8_t"),
-	std::make_pair("u16",    "uint16_t"),
-	std::make_pair("u32",    "uint32_t"),
-	std::make_pair("u64",    "uint64_t"),
-	std::make_pair("byte",   "uint8_t"),
-	std::make_pair("bool",   "bool"),
-	std::make_pair("float",  "float"),
-	std::make_pair("double", "double"),
-	std::make_pair("f32",    "float"),
-	std::make_pair("f64",    "double"),
-	std::make_pair("string", "std::string"),
-}) {}
+Emitter::Emitter(const RootAstNode& root, const std::string& path, const std::string& sourcePath, const std::string& stamp)
+	: root(root), path(path), sourcePath(sourcePath), stamp(stamp) {}
 
 bool Emitter::operator()() {
 	depth = 0;
-	output.reserve(64);
-	output.append("// File autogenerated by scv on: ");
-	output.append(getDate());
-	output.append(R"(
 
-#pragma once
-
-#include <string>
-)");
-	errorOccured = false;
-	emitted.reserve(root.structs.size());
-	for(auto ptr : root.structs) {
-		emitted[ptr->name] = false;
+	{
+		stats::Timer timer(stats::Phase::Symbols);
+		if(!symbols.build(root)) {
+			return false;
+		}
 	}
 
-	// Map deps
-	state = MappingDeps;
-	visit(root);
-
-	if(errorOccured) {
-		return false;
+	{
+		stats::Timer timer(stats::Phase::Compile);
+		expansions.resize(symbols.traits.size());
+		for(size_t i = 0; i < expansions.size(); i++) {
+			const auto node = symbols.traits[i].node;
+			if(node && !expansions[i].compile(*node)) {
+				return false;
+			}
+		}
 	}
 
-	// Map types
-	state = MappingTypes;
-	visit(root);
+	// Nothing can fail past this point, apart from writing itself
+	{
+		stats::Timer timer(stats::Phase::Types);
+		if(!output.open(path, estimateSize())) {
+			return false;
+		}
+		if(!sourcePath.empty()) {
+			if(!source.open(sourcePath, estimateSize())) {
+				return false;
+			}
+			source.append(stamp);
+			source.append("\n\n#include \"");
+			source.append(getFile(path));
+			source.append("\"\n\n");
+		}
 
-	if(errorOccured) {
-		return false;
-	}
+		output.append(stamp);
+		output.append(R"(
 
-	state = MappingMembers;
-	visit(root);
+#pragma once
 
-	if(errorOccured) {
-		return false;
-	}
+#include <string>
+)");
 
-	// Map traits
-	state = MappingTraits;
-	traits.reserve(root.traits.size());
-	usedRequirements.reserve(root.traits.size());
-	for(auto ptr : root.traits) {
-		auto res = traits.try_emplace(ptr->name, ptr);
-		if(!res.second) {
-			error::onToken("Duplicate trait encountered", *ptr->origin);
-			return false;
+		for(auto& req : symbols.requirements) {
+			output.append("#include ");
+			output.append(req);
+			output.append("\n");
 		}
-	}
-	visit(root);
 
-	for(auto& req : usedRequirements) {
-		output.append("#include ");
-		output.append(req);
 		output.append("\n");
-	}
 
-	output.append("\n");
+		if(symbols.inlineStrings) {
+			writeInlineStringPrelude();
+		}
 
-	// Write types
-	state = WritingTypes;
-	visit(root);
+		const bool varints = std::any_of(symbols.traits.begin(), symbols.traits.end(), [](const auto& trait) {
+			return trait.builtin && trait.builtin->usesVarints();
+		});
+		if(varints) {
+			writeVarintPrelude(output);
+		}
 
-	if(errorOccured) {
-		return false;
-	}
+		for(const auto& trait : symbols.traits) {
+			if(trait.builtin) {
+				trait.builtin->writePrelude(output);
+			}
+		}
 
-	// Write traits
-	for(auto ptr : root.structs) {
-		emitted[ptr->name] = false;
-	}
-	state = WritingTraits;
-	outputResult = true;
-	visit(root);
+		if(global::reflectFlag) {
+			writeReflectPrelude();
+		}
 
-	if(errorOccured) {
-		return false;
+		writeTypes();
 	}
 
-	while(std::isspace(output.back())) {
-		output.pop_back();
+	{
+		stats::Timer timer(stats::Phase::Traits);
+		writeTraits();
 	}
 
-	std::ofstream file(path.c_str());
-	if(!file.is_open()) {
-		error::set("Cannot open file '" + path + "'\n");
+	stats::Timer timer(stats::Phase::Commit);
+	if(!output.close()) {
 		return false;
 	}
-
-	file.write(output.c_str(), output.size());
+	stats::addOutput(path, output.size(), output.changed());
+	if(!sourcePath.empty()) {
+		if(!source.close()) {
+			return false;
+		}
+		stats::addOutput(sourcePath, source.size(), source.changed());
+	}
 	return true;
 }
 
-void Emitter::visit(const RootAstNode& node) {
-	for(auto ptr : node.structs) {
-		activeStructName = &ptr->name;
-		visit(*ptr);
+size_t Emitter::bytesWritten() const {
+	return output.size() + (sourcePath.empty() ? 0 : source.size());
+}
+
+size_t Emitter::estimateSize() const {
+	constexpr size_t lineSize = 32;
+	size_t size = stamp.size() + lineSize * (symbols.requirements.size() + 4);
+	for(const auto& struc : symbols.structs) {
+		size += lineSize * (struc.members.size() + 2);
+		for(auto trait : struc.traits) {
+			const auto builtin = symbols.traits[trait].builtin;
+			size += builtin ? builtin->estimateSize(struc) : expansions[trait].estimateSize(struc);
+		}
 	}
+	return size;
 }
 
-void Emitter::visit(const StructAstNode& node) {
-	const std::string* shouldBeNull;
-	std::vector<std::string> deps;
-	const TraitAstNode* trait;
-
-	switch(state) {
-		case MappingTypes:
-			shouldBeNull = findType(node.name);
-			if(shouldBeNull != nullptr) {
-				error::onToken("Type '" + node.name + "' already defined", *node.origin);
-				errorOccured = true;
-				return;
-			} else {
-				types[node.name] = node.name;
-			}
-			break;
-		case MappingDeps:
-			for(const auto& child : node.children) {
-				child->accept(*this);
-			}
-			dependencies.insert({node.name, std::move(collectedDependencies)});
-			break;
-		case MappingMembers:
-			for(auto& child : node.children) {
-				child->accept(*this);
-			}
-			break;
-		case MappingTraits:
-			for(auto& name : node.traits) {
-				trait = findTrait(name);
-				if(trait == nullptr) {
-					error::onToken("Trait '" + name + "' requested is never defined", *node.origin);
-					errorOccured = true;
-					return;
-				}
-
-				for(auto& req : trait->requirements) {
-					usedRequirements.insert(req);
-				}
-			}
-			break;
-		case WritingTypes:
-			if(emitted[node.name]) {
-				return;
-			}
+// Every type is written after the types it depends on
+void Emitter::writeTypes() {
+	for(auto id : symbols.order) {
+		writeStruct(symbols.structs[id]);
+		if(global::reflectFlag) {
+			writeDescriptor(symbols.structs[id]);
+		}
+	}
+}
 
-			deps = dependencies[node.name];
-			for(const auto& dep : deps) {
-				auto stru = findStruct(dep);
-				if(stru->name == *activeStructName) {
-					error::onToken("Cyclic dependency detected inside struct", *node.origin);
-					errorOccured = true;
-					return;
-				}
-				visit(*stru);
-			}
+void Emitter::writeStruct(const SymbolTable::Struct& struc) {
+	output.append("struct ");
+	output.append(struc.node->name);
+	output.append(" {\n");
+	dig();
+	for(size_t i = 0; i < struc.layout.size(); i++) {
+		const auto& member = symbols.memberAt(struc, i);
+		pad();
+		output.append(symbols.types[member.type].spelling);
+		output.push_back(' ');
+		output.append(member.node->name);
+		output.append(";\n");
+	}
+	if(struc.cachedHash) {
+		pad();
+		output.append("size_t hashPrecomputed = 0;\n");
+	}
+	if(struc.allocatorAware) {
+		writeAllocatorSupport(struc);
+	}
+	rise();
+	output.append("};\n\n");
 
-			output.append("struct ");
-			output.append(node.name);
-			output.append(" {\n");
-			dig();
-			for(const auto& child : node.children) {
-				child->accept(*this);
-			}
-			rise();
-			output.append("};\n\n");
-			emitted[node.name] = true;
-			break;
-		case WritingTraits:
-			if(emitted[node.name]) {
-				return;
+	if(struc.compact && !struc.members.empty()) {
+		writeLayoutChecks(struc);
+	}
+}
+
+// Allocator aware structs follow the uses-allocator protocol, so that
+// containers using a polymorphic allocator pass it on to their elements.
+// Declaring these constructors means the struct is no longer an aggregate
+void Emitter::writeAllocatorSupport(const SymbolTable::Struct& struc) {
+	const std::string name(struc.node->name);
+	std::string str;
+	str.append("\n\tusing allocator_type = ").append(symbols.allocator).append(";\n\n");
+	str.append("\t" + name + "() = default;\n");
+	str.append("\t" + name + "(const " + name + "&) = default;\n");
+	str.append("\t" + name + "(" + name + "&&) = default;\n");
+	str.append("\t" + name + "& operator=(const " + name + "&) = default;\n");
+	str.append("\t" + name + "& operator=(" + name + "&&) = default;\n\n");
+
+	// Members are initialized in the order they are declared in, which is
+	// their layout order
+	auto initializers = [&](bool fromOther, bool moving) {
+		for(size_t i = 0; i < struc.layout.size(); i++) {
+			const auto& member = symbols.memberAt(struc, i);
+			const std::string memberName(member.node->name);
+			const bool aware = symbols.allocates(member.type);
+			str.append(i == 0 ? " : " : ", ");
+			str.append(memberName + "(");
+			if(fromOther) {
+				str.append(moving && aware ? "std::move(other." + memberName + ")" : "other." + memberName);
 			}
-			emitted[node.name] = true;
-			auto& deps = dependencies[node.name];
-			for(auto& dep : deps) {
-				if(!emitted[dep]) {
-					auto stru = findStruct(dep);
-					visit(*stru);
-				}
+			if(aware) {
+				str.append(fromOther ? ", allocator" : "allocator");
 			}
+			str.append(")");
+		}
+		str.append(" {}\n");
+	};
+	str.append("\texplicit " + name + "(const allocator_type& allocator)");
+	initializers(false, false);
+	str.append("\t" + name + "(const " + name + "& other, const allocator_type& allocator)");
+	initializers(true, false);
+	str.append("\t" + name + "(" + name + "&& other, const allocator_type& allocator)");
+	initializers(true, true);
+
+	const auto& first = *std::find_if(struc.members.begin(), struc.members.end(), [&](const auto& member) {
+		return symbols.allocates(member.type);
+	});
+	str.append("\n\tallocator_type get_allocator() const {\n\t\treturn ");
+	str.append(first.node->name).append(".get_allocator();\n\t}\n");
+	output.append(str);
+}
 
-			activeStruct = &node;
-			for(auto& name : node.traits) {
-				trait = findTrait(name);
-				visit(*trait);
-			}
-			break;
+// Compact structs have no padding between members, only at the end. Types
+// of unknown size are left for the compiler to fill in
+void Emitter::writeLayoutChecks(const SymbolTable::Struct& struc) {
+	const auto name = struc.node->name;
+	size_t fixed = 0;
+	std::vector<std::pair<std::string_view, size_t>> variable;
+	for(const auto& member : struc.members) {
+		const auto& type = symbols.types[member.type];
+		if(type.fixedWidth()) {
+			fixed += type.size;
+			continue;
+		}
+		auto it = std::find_if(variable.begin(), variable.end(), [&](const auto& pair) {
+			return pair.first == type.spelling;
+		});
+		if(it == variable.end()) {
+			variable.emplace_back(type.spelling, 1);
+		} else {
+			++it->second;
+		}
+	}
+	// The cached hash lies last, and is as aligned as any member
+	if(struc.cachedHash) {
+		variable.emplace_back("size_t", 1);
+	}
+
+	output.append("static_assert(sizeof(");
+	output.append(name);
+	if(variable.empty()) {
+		const size_t size = (fixed + struc.alignment - 1) / struc.alignment * struc.alignment;
+		output.append(") == " + std::to_string(size) + " && alignof(");
+		output.append(name);
+		output.append(") == " + std::to_string(struc.alignment));
+	} else {
+		std::string sum;
+		for(const auto& [spelling, count] : variable) {
+			sum.append(count > 1 ? std::to_string(count) + " * sizeof(" : "sizeof(");
+			sum.append(spelling);
+			sum.append(") + ");
+		}
+		sum.append(std::to_string(fixed));
+		const std::string alignment = "alignof(" + std::string(name) + ")";
+		output.append(") == (" + sum + " + " + alignment + " - 1) / " + alignment + " * " + alignment);
 	}
+	output.append(", \"");
+	output.append(name);
+	output.append(" is not laid out as scv expects\");\n\n");
 }
 
-void Emitter::visit(const MemberAstNode& node) {
-	const std::string* type;
-	const std::string* name;
+// Inline strings keep the structs holding them trivially copyable, so that
+// they can be copied as bytes or placed in shared memory. Bytes past the
+// length are kept zero, and a length beyond the capacity, which can only
+// come from bytes copied in, reads as the capacity
+void Emitter::writeInlineStringPrelude() {
+	output.append(R"(#ifndef SCV_INLINE_STRING
+#define SCV_INLINE_STRING
+namespace scv {
+
+template<size_t Capacity>
+class InlineString {
+	static_assert(Capacity > 0 && Capacity < 256, "Inline strings hold their length in a byte");
+public:
+	static constexpr size_t capacity = Capacity;
+
+	InlineString() = default;
+
+	// Truncated to the capacity
+	InlineString(std::string_view str) {
+		assign(str);
+	}
 
-	switch(state) {
-		case MappingDeps:
-			type = findType(node.type);
-			if(type == nullptr) {
-				collectedDependencies.push_back(node.type);
-			}
+	InlineString(const char* str) : InlineString(std::string_view(str)) {}
 
-			return;
-			break;
-		case MappingMembers:
-			type = findType(node.type);
-			if(type == nullptr) {
-				error::onToken("Type '" + node.type + "' not defined", *node.origin);
-				errorOccured = true;
-				return;
-			}
-			break;
-		case WritingTypes:
-			type = findType(node.type);
-			if(type == nullptr) {
-				error::onToken("Type '" + node.type + "' not defined", *node.origin);
-				errorOccured = true;
-				return;
-			}
-			pad();
-			output.append(*type);
-			output.push_back(' ');
-			name = findType(node.name);
-			if(name) {
-				error::onToken("Cannot name a member '" + node.name + "'", *node.nameToken);
-				errorOccured = true;
-				return;
-			}
-			output.append(node.name);
-			output.append(";\n");
-			break;
-		case WritingTraits:
-			collected = node.name;
-			break;
+	InlineString& operator=(std::string_view str) {
+		assign(str);
+		return *this;
 	}
-}
 
-void Emitter::visit(const TraitAstNode& node) {
-	for(auto& child : node.children) {
-		child->accept(*this);
+	InlineString& operator=(const char* str) {
+		return *this = std::string_view(str);
 	}
-}
 
-void Emitter::visit(const CodeAstNode& node) {
-	std::string sum;
-	for(auto& child : node.children) {
-		child->accept(*this);
-		if(!outputResult) {
-			sum += collected;
-		}
+	// Returns false when the string did not fit and was truncated
+	bool assign(std::string_view str) {
+		const size_t size = str.size() < Capacity ? str.size() : Capacity;
+		std::memcpy(bytes, str.data(), size);
+		std::memset(bytes + size, 0, Capacity - size);
+		length = static_cast<uint8_t>(size);
+		return size == str.size();
 	}
 
-	if(!outputResult) {
-		collected = sum;
-	} else {
-		output.append("\n");
+	static bool fits(std::string_view str) {
+		return str.size() <= Capacity;
 	}
-}
 
-void Emitter::visit(const SegmentAstNode& node) {
-	if(outputResult) {
-		output.append(node.segment);
-	} else {
-		collected = node.segment;
+	size_t size() const {
+		return length < Capacity ? length : Capacity;
 	}
-}
 
-void Emitter::visit(const MacroAstNode& node) {
-	std::string result;
-	if(node.name == "Type") {
-		result = doTypeMacro(node);
-	} else if(node.name == "ForMemberIn") {
-		result = doForMemberInMacro(node);
-	} else if(node.name == "Member") {
-		activeStruct->children[currentMember]->accept(*this);
-		result = collected;
-		result += ' ';
-	} else {
-		error::onToken("Unrecognized macro: '" + node.name + "'", *node.origin);
+	bool empty() const {
+		return length == 0;
 	}
 
-	if(outputResult) {
-		output.append(result);
-	} else {
-		collected = result;
+	const char* data() const {
+		return bytes;
 	}
-}
-
-std::string Emitter::doTypeMacro(const MacroAstNode& node) {
-	return activeStruct->name;
-}
 
-std::string Emitter::doForMemberInMacro(const MacroAstNode& node) {
-	if(node.children.size() != 1) {
-		error::onToken("Macro of type 'ForMemberIn' requires exactly 1 argument, " + std::to_string(node.children.size()) + " provided", *node.origin);
-		errorOccured = true;
-		return "";
+	std::string_view view() const {
+		return std::string_view(bytes, size());
 	}
 
-	if(!node.optionalCode) {
-		error::onToken("Macro of type 'ForMemberIn' requires a code block attached to it, none provided", *node.origin);
-		errorOccured= true;
-		return "";
+	operator std::string_view() const {
+		return view();
 	}
 
-	auto prevState = outputResult;
-	outputResult = false;
-	node.children.front()->accept(*this);
+	void clear() {
+		assign(std::string_view());
+	}
 
-	const StructAstNode* requested = nullptr;
-	for(auto* struc : root.structs) {
-		if(struc->name == collected) {
-			requested = struc;
-		}
+	friend bool operator==(const InlineString& lhs, const InlineString& rhs) {
+		return lhs.view() == rhs.view();
 	}
 
-	if(requested == nullptr) {
-		error::onToken("Can not find type with name '" + collected + "'", *node.children.front()->origin);
-		errorOccured = true;
-		return "";
+	friend bool operator!=(const InlineString& lhs, const InlineString& rhs) {
+		return !(lhs == rhs);
 	}
+private:
+	uint8_t length = 0;
+	char bytes[Capacity] = {};
+};
+
+}
+#endif
+
+)");
+}
+
+// Every struct is described by its fields in declaration order, which
+// traits written as templates fold over. The fields are spelled out in a
+// function rather than held in a std::tuple, as instantiating a tuple type
+// per struct dominates the time taken to compile the header
+void Emitter::writeReflectPrelude() {
+	output.append(R"(#ifndef SCV_REFLECT_PRELUDE
+#define SCV_REFLECT_PRELUDE
+namespace scv::reflect {
+
+enum class Tag {
+	Signed,
+	Unsigned,
+	Float,
+	Bool,
+	String,
+	InlineString,
+	Array,
+	Sequence,
+	Struct,
+};
+
+template<typename Class, typename Member>
+struct Field {
+	using type = Member;
+	std::string_view name;
+	Member Class::* pointer;
+	Tag tag;
+};
+
+// Specialized for every struct, passing each of its fields in turn to a
+// function. Nothing is instantiated for structs no trait is used with
+template<typename T>
+struct Descriptor;
+
+// Specialized for every trait a struct implements
+template<typename T, typename Trait>
+inline constexpr bool implements = false;
+
+template<typename T, typename F>
+constexpr void forEach(F&& f) {
+	Descriptor<T>::forEach(f);
+}
+
+// Arrays and sequences, told apart from scalars by @IfSequence and @IfScalar
+template<typename T>
+inline constexpr bool isSequence = false;
+
+template<typename T, size_t N>
+inline constexpr bool isSequence<std::array<T, N>> = true;
 
-	auto prevActiveStruct = activeStruct;
-	activeStruct = requested;
+template<typename T, typename Allocator>
+inline constexpr bool isSequence<std::vector<T, Allocator>> = true;
 
-	currentMember = 0;
-	std::string sum;
-	for(; currentMember < requested->children.size(); currentMember++) {
-		node.optionalCode->accept(*this);
-		sum += collected;
+}
+#endif
+
+)");
+
+	std::string tags;
+	for(const auto& trait : symbols.traits) {
+		if(trait.node) {
+			tags.append("struct ").append(trait.node->name).append(";\n");
+		}
+	}
+	if(!tags.empty()) {
+		output.append("namespace scv::reflect::trait {\n\n" + tags + "\n}\n\n");
 	}
-	outputResult = prevState;
+}
 
-	return sum;
+void Emitter::writeDescriptor(const SymbolTable::Struct& struc) {
+	constexpr std::string_view tags[] = {
+		"Signed", "Unsigned", "Float", "Bool", "String", "InlineString", "Array", "Sequence", "Struct",
+	};
+
+	const std::string name(struc.node->name);
+	std::string str;
+	str.append("namespace scv::reflect {\n\ntemplate<>\nstruct Descriptor<" + name + "> {\n");
+	str.append("\tstatic constexpr size_t size = " + std::to_string(struc.members.size()) + ";\n\n");
+	str.append("\ttemplate<typename F>\n\tstatic constexpr void forEach(");
+	str.append(struc.members.empty() ? "F&&) {\n" : "F&& f) {\n");
+	for(const auto& member : struc.members) {
+		const auto& type = symbols.types[member.type];
+		const std::string memberName(member.node->name);
+		str.append("\t\tf(Field<" + name + ", ").append(type.spelling).append(">{\"" + memberName + "\", &");
+		str.append(name + "::" + memberName + ", Tag::").append(tags[static_cast<size_t>(type.kind)]).append("});\n");
+	}
+	str.append("\t}\n};\n\n");
+	for(auto trait : struc.traits) {
+		if(const auto node = symbols.traits[trait].node; node) {
+			str.append("template<>\ninline constexpr bool implements<" + name + ", trait::");
+			str.append(node->name).append("> = true;\n\n");
+		}
+	}
+	str.append("}\n\n");
+	output.append(str);
 }
 
-StructAstNode* Emitter::findStruct(const std::string& str) {
-	for(auto stru : root.structs) {
-		if(stru->name == str) {
-			return stru;
+// Trait implementations follow the same order as the types. Traits from a
+// spec are written once as templates instead when reflecting
+void Emitter::writeTraits() {
+	size_t expanded = 0;
+	std::vector<bool> used(symbols.traits.size());
+	for(auto id : symbols.order) {
+		const auto& struc = symbols.structs[id];
+		for(auto trait : struc.traits) {
+			if(const auto builtin = symbols.traits[trait].builtin; builtin) {
+				builtin->write(symbols, struc, output);
+			} else if(global::reflectFlag) {
+				used[trait] = true;
+			} else {
+				expanded += expansions[trait].run(symbols, struc, output, sourcePath.empty() ? nullptr : &source, symbols.traits[trait].inlined);
+			}
+		}
+	}
+
+	for(size_t trait = 0; trait < used.size(); trait++) {
+		if(used[trait]) {
+			expanded += expansions[trait].runTemplate(symbols, symbols.traits[trait].node->name, output);
 		}
 	}
-	return nullptr;
+	stats::add(stats::Counter::Expansions, expanded);
 }
 
 void Emitter::dig() {
@@ -385,19 +483,3 @@ void Emitter::pad() {
 		output.push_back('\t');
 	}
 }
-
-const std::string* Emitter::findType(const std::string& str) {
-	auto it = types.find(str);
-	if(it == types.cend()) {
-		return nullptr;
-	}
-	return &it->second;
-}
-
-const TraitAstNode* Emitter::findTrait(const std::string& str) {
-	auto it = traits.find(str);
-	if(it == traits.cend()) {
-		return nullptr;
-	}
-	return it->second;
-}
@@ -1,6 +1,8 @@
 #include "error.hpp"
 
-std::string errorString;
+// Each thread reports into its own channel, allowing the front end to run
+// files in parallel and collect errors per task
+thread_local std::string errorString;
 
 namespace error {
 
@@ -9,14 +11,19 @@ void set(const std::string& str) {
 }
 
 void onToken(const std::string& str, const Token& tok) {
+	auto location = locate(tok);
 	errorString.resize(128);
-	std::snprintf(errorString.data(), errorString.size(), "%d:%d %s\n", tok.row, tok.column, str.c_str());
+	std::snprintf(errorString.data(), errorString.size(), "%d:%d %s\n", location.row, location.column, str.c_str());
 }
 
 const std::string& get() {
 	return errorString;
 }
 
+void clear() {
+	errorString.clear();
+}
+
 bool empty() {
 	return errorString.empty();
 }
@@ -0,0 +1,407 @@
+#include "expansion.hpp"
+
+#include "error.hpp"
+#include "global.hpp"
+
+#include <cctype>
+
+class ExpansionCompiler : public AstVisitor {
+public:
+	ExpansionCompiler(Expansion& expansion) : expansion(expansion) {}
+
+	void visit(const RootAstNode&) final {}
+	void visit(const StructAstNode&) final {}
+	void visit(const MemberAstNode&) final {}
+
+	void visit(const TraitAstNode& node) final {
+		for(auto& child : node.children) {
+			declaration = expansion.program.size();
+			signature.clear();
+			scanning = true;
+			emit(Expansion::Op::DeclarationBegin);
+			child->accept(*this);
+			scanning = false;
+			emit(Expansion::Op::Literal, "\n");
+		}
+	}
+
+	void visit(const CodeAstNode& node) final {
+		for(auto& child : node.children) {
+			child->accept(*this);
+		}
+	}
+
+	void visit(const SegmentAstNode& node) final {
+		if(!node.segment.empty()) {
+			doLiteral(node.segment);
+		}
+	}
+
+	void visit(const MacroAstNode& node) final {
+		switch(node.kind) {
+			case MacroKind::Type:
+				signature.append("T");
+				emit(Expansion::Op::TypeName);
+				break;
+			case MacroKind::Member:
+				if(loops.empty()) {
+					error::onToken("Macro of type 'Member' used outside of 'ForMemberIn'", *node.origin);
+					failed = true;
+					return;
+				}
+				doMember(node);
+				break;
+			case MacroKind::ForMemberIn:
+				doForMemberIn(node);
+				break;
+			case MacroKind::Allocator:
+				emit(Expansion::Op::AllocatorName);
+				break;
+			case MacroKind::IfSequence:
+			case MacroKind::IfScalar:
+				doIf(node);
+				break;
+			case MacroKind::N_MacroKinds:
+				break;
+		}
+	}
+
+	bool failed = false;
+private:
+	// Code blocks defining a function are split where the body starts, so
+	// that the declaration can be written apart from the definition
+	void doLiteral(std::string_view text) {
+		const size_t end = scanning ? text.find_first_of("{;") : std::string_view::npos;
+		if(end == std::string_view::npos) {
+			if(scanning) {
+				signature.append(text);
+			}
+			emit(Expansion::Op::Literal, text);
+			return;
+		}
+
+		scanning = false;
+		signature.append(text.substr(0, end));
+		if(text[end] != '{' || !declaresFunction(signature)) {
+			emit(Expansion::Op::Literal, text);
+			return;
+		}
+
+		auto head = text.substr(0, end);
+		const auto last = head.find_last_not_of(" \t\r\n");
+		head = head.substr(0, last == std::string_view::npos ? 0 : last + 1);
+		if(!head.empty()) {
+			emit(Expansion::Op::Literal, head);
+		}
+		expansion.program[declaration].jump = 1;
+		emit(Expansion::Op::BodyBegin);
+		emit(Expansion::Op::Literal, text.substr(head.size()));
+	}
+
+	// Only functions with external linkage can be moved out of a header.
+	// Anything declared inline, static, constexpr or as a template, and
+	// anything that is not a function, is left where it is
+	static bool declaresFunction(std::string_view signature) {
+		constexpr std::string_view keywords[] = {
+			"template", "struct", "class", "union", "enum", "namespace", "static", "inline", "constexpr", "using",
+		};
+
+		const auto first = signature.find_first_not_of(" \t\r\n");
+		if(first == std::string_view::npos) {
+			return false;
+		}
+		signature.remove_prefix(first);
+		for(const auto keyword : keywords) {
+			if(signature.substr(0, keyword.size()) == keyword
+				&& (signature.size() == keyword.size() || !std::isalnum(static_cast<unsigned char>(signature[keyword.size()])))) {
+				return false;
+			}
+		}
+
+		// Variables initialized with a lambda have a '=' before their '('
+		const auto paren = signature.find('(');
+		if(paren == std::string_view::npos) {
+			return false;
+		}
+		const auto prefix = signature.substr(0, paren);
+		return prefix.find('=') == std::string_view::npos || prefix.find("operator") != std::string_view::npos;
+	}
+
+	// The object a member is accessed on, such as "value." or "ptr->", is
+	// moved from the literal before the member into the member itself, so
+	// that templates can apply a pointer to member to it
+	void doMember(const MacroAstNode& node) {
+		std::string_view object;
+		if(!expansion.program.empty() && expansion.program.back().op == Expansion::Op::Literal) {
+			auto& literal = expansion.program.back().text;
+			object = literal.substr(literal.size() - objectLength(literal));
+			literal.remove_suffix(object.size());
+			currentSize() -= object.size();
+		}
+
+		if(object.empty() && global::reflectFlag) {
+			error::onToken("Macro of type 'Member' must follow an object and '.' or '->' when reflecting", *node.origin);
+			failed = true;
+			return;
+		}
+		emit(Expansion::Op::MemberName, object);
+	}
+
+	static size_t objectLength(std::string_view text) {
+		size_t accessor = 0;
+		if(!text.empty() && text.back() == '.') {
+			accessor = 1;
+		} else if(text.size() >= 2 && text.substr(text.size() - 2) == "->") {
+			accessor = 2;
+		} else {
+			return 0;
+		}
+
+		const size_t end = text.size() - accessor;
+		size_t begin = end;
+		while(begin > 0) {
+			const char c = text[begin - 1];
+			if(std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == ':') {
+				--begin;
+			} else if(c == '>' && begin >= 2 && text[begin - 2] == '-') {
+				begin -= 2;
+			} else {
+				break;
+			}
+		}
+		return begin == end ? 0 : text.size() - begin;
+	}
+
+	void doForMemberIn(const MacroAstNode& node) {
+		if(node.children.size() != 1) {
+			error::onToken("Macro of type 'ForMemberIn' requires exactly 1 argument, " + std::to_string(node.children.size()) + " provided", *node.origin);
+			failed = true;
+			return;
+		}
+
+		if(!node.optionalCode) {
+			error::onToken("Macro of type 'ForMemberIn' requires a code block attached to it, none provided", *node.origin);
+			failed = true;
+			return;
+		}
+
+		auto arg = static_cast<const MacroAstNode*>(node.children.front());
+		if(arg->kind != MacroKind::Type) {
+			error::onToken("Macro of type 'ForMemberIn' can only iterate over '@Type'", *arg->origin);
+			failed = true;
+			return;
+		}
+
+		if(loops.size() == Expansion::maxLoopDepth) {
+			error::onToken("Macro of type 'ForMemberIn' nested too deeply", *node.origin);
+			failed = true;
+			return;
+		}
+
+		scanning = false;
+		loops.push_back(expansion.program.size());
+		emit(Expansion::Op::LoopBegin);
+		node.optionalCode->accept(*this);
+		const uint32_t begin = loops.back();
+		loops.pop_back();
+		expansion.program[begin].jump = expansion.program.size();
+		emit(Expansion::Op::LoopEnd, {}, begin);
+	}
+
+	void doIf(const MacroAstNode& node) {
+		const std::string name(macroNames[static_cast<size_t>(node.kind)]);
+		if(loops.empty()) {
+			error::onToken("Macro of type '" + name + "' used outside of 'ForMemberIn'", *node.origin);
+			failed = true;
+			return;
+		}
+
+		if(!node.children.empty()) {
+			error::onToken("Macro of type '" + name + "' takes no arguments", *node.origin);
+			failed = true;
+			return;
+		}
+
+		if(!node.optionalCode) {
+			error::onToken("Macro of type '" + name + "' requires a code block attached to it, none provided", *node.origin);
+			failed = true;
+			return;
+		}
+
+		const uint32_t begin = expansion.program.size();
+		emit(node.kind == MacroKind::IfSequence ? Expansion::Op::IfSequence : Expansion::Op::IfScalar);
+		node.optionalCode->accept(*this);
+		expansion.program[begin].jump = expansion.program.size();
+		emit(Expansion::Op::IfEnd);
+	}
+
+	void emit(Expansion::Op op, std::string_view text = {}, uint32_t jump = 0) {
+		expansion.program.push_back(Expansion::Instruction{op, jump, text});
+		currentSize() += text.size();
+	}
+
+	size_t& currentSize() {
+		return loops.empty() ? expansion.fixedSize : expansion.perMemberSize;
+	}
+
+	Expansion& expansion;
+	std::vector<uint32_t> loops;
+	// The code block being compiled, and what it declares up to its first
+	// brace or semicolon while still looking for either
+	size_t declaration = 0;
+	std::string signature;
+	bool scanning = false;
+};
+
+bool Expansion::compile(const TraitAstNode& trait) {
+	program.clear();
+	fixedSize = 0;
+	perMemberSize = 0;
+	ExpansionCompiler compiler(*this);
+	compiler.visit(trait);
+	return !compiler.failed;
+}
+
+// With a source to write to, functions are declared in the output and
+// defined in the source, their signatures being written to both
+size_t Expansion::run(const SymbolTable& symbols, const SymbolTable::Struct& struc, OutputWriter& output, OutputWriter* source, bool inlined) const {
+	// Current member of every loop entered
+	size_t members[maxLoopDepth];
+	size_t depth = 0;
+	size_t expanded = 0;
+	const size_t nMembers = struc.members.size();
+	OutputWriter* out = &output;
+	bool both = false;
+	auto write = [&](std::string_view text) {
+		out->append(text);
+		if(both) {
+			source->append(text);
+		}
+	};
+
+	for(size_t pc = 0; pc < program.size(); pc++) {
+		const auto& instruction = program[pc];
+		switch(instruction.op) {
+			case Op::Literal:
+				write(instruction.text);
+				break;
+			case Op::DeclarationBegin:
+				out = &output;
+				both = false;
+				if(instruction.jump && inlined) {
+					output.append("inline ");
+				} else if(instruction.jump && source) {
+					both = true;
+				}
+				break;
+			case Op::BodyBegin:
+				if(both) {
+					output.append(";\n");
+					out = source;
+					both = false;
+				}
+				break;
+			case Op::TypeName:
+				write(struc.node->name);
+				++expanded;
+				break;
+			case Op::MemberName:
+				write(instruction.text);
+				write(struc.members[members[depth - 1]].node->name);
+				write(" ");
+				++expanded;
+				break;
+			case Op::AllocatorName:
+				write(symbols.allocator);
+				++expanded;
+				break;
+			case Op::LoopBegin:
+				if(nMembers == 0) {
+					pc = instruction.jump;
+				} else {
+					members[depth++] = 0;
+				}
+				break;
+			case Op::LoopEnd:
+				if(++members[depth - 1] < nMembers) {
+					pc = instruction.jump;
+				} else {
+					--depth;
+				}
+				break;
+			case Op::IfSequence:
+			case Op::IfScalar: {
+				const auto& type = symbols.types[struc.members[members[depth - 1]].type];
+				if((type.element != SymbolTable::none) != (instruction.op == Op::IfSequence)) {
+					pc = instruction.jump;
+				}
+				break;
+			}
+			case Op::IfEnd:
+				break;
+		}
+	}
+	return expanded;
+}
+
+// Members are reached through pointers to members, so that value.@Member
+// becomes (value.*field.pointer), loops become folds over the fields and
+// conditions on members are decided at compile time
+size_t Expansion::runTemplate(const SymbolTable& symbols, std::string_view trait, OutputWriter& output) const {
+	size_t depth = 0;
+	size_t expanded = 0;
+
+	for(const auto& instruction : program) {
+		switch(instruction.op) {
+			case Op::Literal:
+				output.append(instruction.text);
+				break;
+			case Op::BodyBegin:
+				break;
+			case Op::DeclarationBegin:
+				output.append("template<typename T, std::enable_if_t<scv::reflect::implements<T, scv::reflect::trait::");
+				output.append(trait);
+				output.append(">, int> = 0>\n");
+				break;
+			case Op::TypeName:
+				output.push_back('T');
+				++expanded;
+				break;
+			case Op::MemberName: {
+				const bool arrow = instruction.text.back() == '>';
+				output.push_back('(');
+				output.append(instruction.text.substr(0, instruction.text.size() - (arrow ? 2 : 1)));
+				output.append(arrow ? "->*scvField" : ".*scvField");
+				output.append(std::to_string(depth - 1) + ".pointer) ");
+				++expanded;
+				break;
+			}
+			case Op::AllocatorName:
+				output.append(symbols.allocator);
+				++expanded;
+				break;
+			case Op::LoopBegin:
+				output.append("scv::reflect::forEach<T>([&]([[maybe_unused]] const auto& scvField" + std::to_string(depth++) + ") {");
+				break;
+			case Op::LoopEnd:
+				--depth;
+				output.append("});");
+				break;
+			case Op::IfSequence:
+			case Op::IfScalar:
+				output.append(instruction.op == Op::IfSequence ? "if constexpr(" : "if constexpr(!");
+				output.append("scv::reflect::isSequence<typename std::decay_t<decltype(scvField" + std::to_string(depth - 1) + ")>::type>) {");
+				break;
+			case Op::IfEnd:
+				output.push_back('}');
+				break;
+		}
+	}
+	return expanded;
+}
+
+// Exact apart from the lengths of names
+size_t Expansion::estimateSize(const SymbolTable::Struct& struc) const {
+	constexpr size_t nameSize = 16;
+	return fixedSize + struc.members.size() * (perMemberSize + nameSize);
+}
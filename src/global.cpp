@@ -6,5 +6,26 @@ std::string outputPath;
 bool verboseAllFlag = false;
 bool verboseTokenizationFlag = false;
 bool verboseAstFlag = false;
+int jobs = 1;
+std::string cachePath;
+bool reproducibleFlag = false;
+bool compactFlag = false;
+bool pmrFlag = false;
+bool reflectFlag = false;
+bool splitFlag = false;
+bool statsFlag = false;
+std::string statsJsonPath;
+
+std::string fingerprint() {
+	std::string str;
+	str.append("version ").append(version).append("\n");
+	str.append("output ").append(outputPath).append("\n");
+	str.append("reproducible ").append(reproducibleFlag ? "1" : "0").append("\n");
+	str.append("compact ").append(compactFlag ? "1" : "0").append("\n");
+	str.append("pmr ").append(pmrFlag ? "1" : "0").append("\n");
+	str.append("reflect ").append(reflectFlag ? "1" : "0").append("\n");
+	str.append("split ").append(splitFlag ? "1" : "0").append("\n");
+	return str;
+}
 
 }
@@ -0,0 +1,34 @@
+#include "hash.hpp"
+
+void Hasher::update(std::string_view sv) {
+	for(const char c : sv) {
+		state ^= static_cast<unsigned char>(c);
+		state *= 0x100000001b3;
+	}
+}
+
+void Hasher::update(uint64_t value) {
+	for(int i = 0; i < 8; i++) {
+		state ^= value & 0xff;
+		state *= 0x100000001b3;
+		value >>= 8;
+	}
+}
+
+uint64_t Hasher::digest() const {
+	return state;
+}
+
+std::string Hasher::hex() const {
+	return toHex(state);
+}
+
+std::string toHex(uint64_t value) {
+	constexpr std::string_view digits = "0123456789abcdef";
+	std::string str(16, '0');
+	for(auto it = str.rbegin(); it != str.rend(); it++) {
+		*it = digits[value & 0xf];
+		value >>= 4;
+	}
+	return str;
+}
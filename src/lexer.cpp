@@ -5,112 +5,326 @@
 #include <algorithm>
 #include <iostream>
 
-Lexer::Lexer(const std::string& src) : src(src) {}
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Classification of every byte, matching what the <cctype> functions report
+// in the "C" locale
+enum CharClass : uint8_t {
+	Space           = 1 << 0,
+	IdentifierStart = 1 << 1,
+	IdentifierPart  = 1 << 2,
+	Punctuation     = 1 << 3,
+};
+
+constexpr bool isSpaceChar(unsigned c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr bool isPunctChar(unsigned c) {
+	return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+constexpr bool isAlphaChar(unsigned c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr auto charClasses = []() {
+	std::array<uint8_t, 256> table = {};
+	for(unsigned c = 0; c < table.size(); c++) {
+		uint8_t cls = 0;
+		if(isSpaceChar(c)) {
+			cls |= Space;
+		}
+		if(isAlphaChar(c)) {
+			cls |= IdentifierStart;
+		}
+		if((!isSpaceChar(c) && !isPunctChar(c)) || c == '_') {
+			cls |= IdentifierPart;
+		}
+		if(isPunctChar(c) && c != '`') {
+			cls |= Punctuation;
+		}
+		table[c] = cls;
+	}
+	return table;
+}();
+
+// Type of the token each punctuation character lexes to
+constexpr auto punctuationTypes = []() {
+	std::array<TokenType, 256> table = {};
+	for(auto& type : table) {
+		type = TokenType::Symbol;
+	}
+	for(size_t i = 0; i < tokenStrings.size(); i++) {
+		if(tokenStrings[i].size() == 1) {
+			table[static_cast<unsigned char>(tokenStrings[i].front())] = static_cast<TokenType>(i);
+		}
+	}
+	return table;
+}();
+
+// Every keyword has a distinct length, making the length a perfect hash
+constexpr size_t maxKeywordLength = 8;
+constexpr auto keywordsByLength = []() {
+	std::array<TokenType, maxKeywordLength + 1> table = {};
+	for(auto& type : table) {
+		type = TokenType::Identifier;
+	}
+	for(size_t i = 0; i < tokenStrings.size(); i++) {
+		const auto str = tokenStrings[i];
+		if(str.empty() || !isAlphaChar(str.front())) {
+			continue;
+		}
+		if(str.size() > maxKeywordLength || table[str.size()] != TokenType::Identifier) {
+			throw "Keyword lengths no longer form a perfect hash";
+		}
+		table[str.size()] = static_cast<TokenType>(i);
+	}
+	return table;
+}();
+
+// The fast paths below return the index of the first byte at or after
+// 'first' which does not belong to the run being skipped, or 'last'
+
+#if defined(__AVX2__)
+using Vector = __m256i;
+constexpr size_t vectorWidth = 32;
+
+inline Vector load(const char* ptr) {
+	return _mm256_loadu_si256(reinterpret_cast<const Vector*>(ptr));
+}
+
+inline Vector splat(char c) {
+	return _mm256_set1_epi8(c);
+}
+
+inline Vector equal(Vector a, Vector b) {
+	return _mm256_cmpeq_epi8(a, b);
+}
+
+inline Vector lessSigned(Vector a, Vector b) {
+	return _mm256_cmpgt_epi8(b, a);
+}
+
+inline Vector add(Vector a, Vector b) {
+	return _mm256_add_epi8(a, b);
+}
+
+inline Vector either(Vector a, Vector b) {
+	return _mm256_or_si256(a, b);
+}
+
+inline Vector butNot(Vector a, Vector b) {
+	return _mm256_andnot_si256(b, a);
+}
+
+inline uint32_t mask(Vector v) {
+	return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+}
+#elif defined(__SSE2__)
+using Vector = __m128i;
+constexpr size_t vectorWidth = 16;
+
+inline Vector load(const char* ptr) {
+	return _mm_loadu_si128(reinterpret_cast<const Vector*>(ptr));
+}
+
+inline Vector splat(char c) {
+	return _mm_set1_epi8(c);
+}
+
+inline Vector equal(Vector a, Vector b) {
+	return _mm_cmpeq_epi8(a, b);
+}
+
+inline Vector lessSigned(Vector a, Vector b) {
+	return _mm_cmplt_epi8(a, b);
+}
+
+inline Vector add(Vector a, Vector b) {
+	return _mm_add_epi8(a, b);
+}
+
+inline Vector either(Vector a, Vector b) {
+	return _mm_or_si128(a, b);
+}
+
+inline Vector butNot(Vector a, Vector b) {
+	return _mm_andnot_si128(b, a);
+}
+
+inline uint32_t mask(Vector v) {
+	return static_cast<uint32_t>(_mm_movemask_epi8(v));
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+constexpr uint32_t fullMask = static_cast<uint32_t>((uint64_t(1) << vectorWidth) - 1);
+
+// Bytes within [lo, hi], using the bias trick as there are no unsigned
+// byte comparisons
+inline Vector inRange(Vector v, unsigned char lo, unsigned char hi) {
+	auto biased = add(v, splat(static_cast<char>(0x80 - lo)));
+	return lessSigned(biased, splat(static_cast<char>(-128 + (hi - lo + 1))));
+}
+
+inline Vector spaces(Vector v) {
+	return either(equal(v, splat(' ')), inRange(v, '\t', '\r'));
+}
+
+inline Vector notIdentifierParts(Vector v) {
+	auto punct = either(
+		either(inRange(v, '!', '/'), inRange(v, ':', '@')),
+		either(inRange(v, '[', '`'), inRange(v, '{', '~'))
+	);
+	return either(spaces(v), butNot(punct, equal(v, splat('_'))));
+}
+#endif
+
+template<typename IsStop, typename StopMask>
+inline size_t skip(const char* src, size_t first, size_t last, IsStop isStop, StopMask stopMask) {
+#if defined(__AVX2__) || defined(__SSE2__)
+	while(first + vectorWidth <= last) {
+		const uint32_t stops = stopMask(load(src + first)) & fullMask;
+		if(stops != 0) {
+			return first + __builtin_ctz(stops);
+		}
+		first += vectorWidth;
+	}
+#endif
+	while(first < last && !isStop(static_cast<unsigned char>(src[first]))) {
+		++first;
+	}
+	return first;
+}
+
+inline size_t skipSpaces(const char* src, size_t first, size_t last) {
+	return skip(src, first, last, [](unsigned char c) {
+		return (charClasses[c] & Space) == 0;
+	}
+#if defined(__AVX2__) || defined(__SSE2__)
+	, [](Vector v) {
+		return ~mask(spaces(v));
+	}
+#else
+	, nullptr
+#endif
+	);
+}
+
+inline size_t skipLine(const char* src, size_t first, size_t last) {
+	return skip(src, first, last, [](unsigned char c) {
+		return c == '\n';
+	}
+#if defined(__AVX2__) || defined(__SSE2__)
+	, [](Vector v) {
+		return mask(equal(v, splat('\n')));
+	}
+#else
+	, nullptr
+#endif
+	);
+}
+
+inline size_t skipIdentifier(const char* src, size_t first, size_t last) {
+	return skip(src, first, last, [](unsigned char c) {
+		return (charClasses[c] & IdentifierPart) == 0;
+	}
+#if defined(__AVX2__) || defined(__SSE2__)
+	, [](Vector v) {
+		return mask(notIdentifierParts(v));
+	}
+#else
+	, nullptr
+#endif
+	);
+}
+
+}
+
+Lexer::Lexer(std::string_view src) : src(src) {}
 
 std::vector<Token> Lexer::operator()() {
 	current = 0;
-	column = 1;
-	row = 1;
-	size_t end = src.size();
-	Token token;
+	const size_t end = src.size();
+	const char* data = src.data();
 	std::vector<Token> tokens;
-	tokens.reserve(32);
+	tokens.reserve(estimateTokens());
 
 	while(current < end) {
-		if(current + 1 < end && peek() == '/' && src[current + 1] == '/') {
+		const auto c = static_cast<unsigned char>(data[current]);
+		const auto cls = charClasses[c];
+
+		if(c == '/' && current + 1 < end && data[current + 1] == '/') {
 			// Comment
-			jump(2);
-			while(current < end && peek() != '\n') {
-				next();
-			}
-		} else if(std::isalpha(peek())) {
+			current = skipLine(data, current + 2, end);
+		} else if(cls & IdentifierStart) {
 			// Identifier or keyword
-			lexIdentifierOrKeyword(token, tokens);
-		} else if(std::isspace(peek())) {
-			ignoreWhitespace();
+			lexIdentifierOrKeyword(tokens);
+		} else if(c >= '0' && c <= '9') {
+			// Number
+			lexNumber(tokens);
+		} else if(cls & Space) {
+			current = skipSpaces(data, current + 1, end);
+		} else if(cls & Punctuation) {
+			// Symbol
+			tokens.push_back(Token{data + current, 1, punctuationTypes[c]});
+			++current;
 		} else {
-			// Symbol or unrecognized token
-			token.index = current;
-			const std::string punct(&src[current], 1);
-			auto it = std::find(tokenStrings.cbegin(), tokenStrings.cend(), punct);
-			if(it != tokenStrings.cend()) {
-				token.column = column;
-				token.row = row;
-				token.type = static_cast<TokenType>(std::distance(tokenStrings.cbegin(), it));
-				tokens.push_back(token);
-				next();
-			} else if(std::ispunct(peek()) && peek() != '`') {
-				token.column = column;
-				token.row = row;
-				token.type = TokenType::Symbol;
-				token.value = peek();
-				tokens.push_back(token);
-				token.value.clear();
-				next();
-			} else {
-				errorOnCurrent();
-				return {};
-			}
+			errorOnCurrent();
+			return {};
 		}
 	}
 	return tokens;
 }
 
-void Lexer::lexIdentifierOrKeyword(Token& token, std::vector<Token>& tokens) {
-	int tokenStart = current;
-	uint32_t startColumn = column;
-	uint32_t startRow = row;
-	while(current < src.size() && (!std::isspace(peek()) && !std::ispunct(peek()) || peek() == '_')) {
-		next();
+// Upper bound on the number of tokens, counting every punctuation character
+// and every start of a word. Keeps the token array down to one allocation
+size_t Lexer::estimateTokens() const {
+	size_t n = 0;
+	bool inWord = false;
+	for(const char c : src) {
+		const auto cls = charClasses[static_cast<unsigned char>(c)];
+		const bool isWord = (cls & (Space | Punctuation)) == 0;
+		n += (cls & Punctuation) != 0 || (isWord && !inWord);
+		inWord = isWord;
 	}
-	token.value.assign(&src[tokenStart], current - tokenStart);
-	auto it = std::find(tokenStrings.cbegin(), tokenStrings.cend(), token.value);
+	return n;
+}
 
-	token.column = startColumn;
-	token.row = startRow;
-	token.index = tokenStart;
+void Lexer::lexIdentifierOrKeyword(std::vector<Token>& tokens) {
+	const size_t tokenStart = current;
+	current = skipIdentifier(src.data(), current + 1, src.size());
+	const std::string_view value(src.data() + tokenStart, current - tokenStart);
 
-	if(it != tokenStrings.cend()) {
-		// Keyword
-		token.type = static_cast<TokenType>(std::distance(tokenStrings.cbegin(), it));
-		token.value.clear();
-		tokens.push_back(token);
-	} else {
-		// Identifier
-		token.type = TokenType::Identifier;
-		tokens.push_back(token);
-		token.value.clear();
+	auto type = value.size() <= maxKeywordLength
+		? keywordsByLength[value.size()]
+		: TokenType::Identifier;
+	if(type != TokenType::Identifier && tokenStrings[static_cast<size_t>(type)] != value) {
+		type = TokenType::Identifier;
 	}
+	tokens.push_back(Token{value.data(), static_cast<uint32_t>(value.size()), type});
 }
 
-void Lexer::ignoreWhitespace() {
-	next();
-	while(current < src.size() && std::isspace(src[current])) {
-		next();
-	}
+// Numbers run on like identifiers, taking in suffixes such as in 0x1f or 10u
+void Lexer::lexNumber(std::vector<Token>& tokens) {
+	const size_t tokenStart = current;
+	current = skipIdentifier(src.data(), current + 1, src.size());
+	tokens.push_back(Token{src.data() + tokenStart, static_cast<uint32_t>(current - tokenStart), TokenType::Number});
 }
 
 void Lexer::errorOnCurrent() {
 	std::string buffer;
 	buffer.resize(128);
-	std::snprintf(buffer.data(), buffer.size(), "%d:%d: Unrecognized token '%c'\n", row, column, peek());
+	auto location = locate(src, current);
+	std::snprintf(buffer.data(), buffer.size(), "%d:%d: Unrecognized token '%c'\n", location.row, location.column, peek());
 	error::set(buffer);
 }
 
 char Lexer::peek() {
 	return src[current];
 }
-
-void Lexer::next() {
-	++current;
-	++column;
-	if(peek() == '\n') {
-		column = 0;
-		++row;
-	}
-}
-
-void Lexer::jump(size_t n) {
-	current += n;
-	column += n;
-}
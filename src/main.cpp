@@ -1,6 +1,51 @@
 #include "argparser.hpp"
 #include "global.hpp"
 #include "pipeline.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+
+void* allocate(size_t size) {
+	stats::add(stats::Counter::Allocations, 1);
+	stats::add(stats::Counter::AllocatedBytes, size);
+	if(auto ptr = std::malloc(size ? size : 1); ptr) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+}
+
+// Allocations are counted for --stats by replacing the global allocator of
+// scv itself, rather than that of every program linking the core
+void* operator new(size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](size_t size) {
+	return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
 
 
 int main(int argc, char** argv) {
@@ -9,10 +54,31 @@ int main(int argc, char** argv) {
 	argParser.addBool(&global::verboseTokenizationFlag, "--verbose-tokenization");
 	argParser.addBool(&global::verboseAstFlag, "--verbose-ast");
 	argParser.addString(&global::outputPath, "--output");
+	argParser.addInt(&global::jobs, "--jobs");
+	argParser.addString(&global::cachePath, "--cache");
+	argParser.addBool(&global::reproducibleFlag, "--reproducible");
+	argParser.addBool(&global::compactFlag, "--compact");
+	argParser.addBool(&global::pmrFlag, "--pmr");
+	argParser.addBool(&global::reflectFlag, "--reflect");
+	argParser.addBool(&global::splitFlag, "--split");
+	argParser.addBool(&global::statsFlag, "--stats");
+	argParser.addString(&global::statsJsonPath, "--stats-json");
 
 	auto input = argParser.unwind();
 
+	if(global::statsFlag || !global::statsJsonPath.empty()) {
+		stats::enable();
+	}
+
 	Pipeline::full(input);
 
+	if(global::statsFlag) {
+		stats::print(std::cout);
+	}
+	if(!global::statsJsonPath.empty()) {
+		stats::writeJson(global::statsJsonPath);
+		dieIfError();
+	}
+
 	return EXIT_SUCCESS;
 }
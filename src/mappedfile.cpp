@@ -0,0 +1,83 @@
+#include "mappedfile.hpp"
+
+#include "error.hpp"
+#include "utils.hpp"
+
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define SCV_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	release();
+	const bool usesFallback = other.data != nullptr && other.data == other.fallback.data();
+	fallback = std::move(other.fallback);
+	data = usesFallback ? fallback.data() : other.data;
+	size = other.size;
+	other.data = nullptr;
+	other.size = 0;
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	release();
+}
+
+bool MappedFile::open(const char* path) {
+	release();
+#ifdef SCV_HAS_MMAP
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		error::set(std::string("Could not open file: ") + path + '\n');
+		return false;
+	}
+
+	struct stat st;
+	if(::fstat(fd, &st) != 0) {
+		::close(fd);
+		error::set(std::string("Could not open file: ") + path + '\n');
+		return false;
+	}
+
+	if(st.st_size > 0) {
+		void* ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr != MAP_FAILED) {
+			data = static_cast<const char*>(ptr);
+			size = st.st_size;
+		}
+	}
+	::close(fd);
+
+	if(data != nullptr || st.st_size == 0) {
+		return true;
+	}
+#endif
+	fallback = consume(path);
+	data = fallback.data();
+	size = fallback.size();
+	return error::empty();
+}
+
+std::string_view MappedFile::view() const {
+	return std::string_view(data, size);
+}
+
+void MappedFile::release() {
+#ifdef SCV_HAS_MMAP
+	if(data != nullptr && data != fallback.data()) {
+		::munmap(const_cast<char*>(data), size);
+	}
+#endif
+	fallback.clear();
+	data = nullptr;
+	size = 0;
+}
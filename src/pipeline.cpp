@@ -1,20 +1,129 @@
 #include "pipeline.hpp"
 
 #include "ast.hpp"
+#include "cache.hpp"
 #include "astprinter.hpp"
 #include "emitter.hpp"
+#include "error.hpp"
 #include "global.hpp"
+#include "hash.hpp"
 #include "utils.hpp"
 #include "lexer.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
 
+#include <functional>
 #include <iostream>
 
-std::set<std::string_view> Pipeline::previouslyProcessed;
-std::list<std::string> Pipeline::storedSrcs;
+std::set<std::string, std::less<>> Pipeline::previouslyProcessed;
+std::list<MappedFile> Pipeline::storedSrcs;
+cache::Sources Pipeline::sources;
+std::list<std::vector<Token>> Pipeline::storedTokens;
+std::mutex Pipeline::storageMutex;
 
 void Pipeline::full(const std::vector<std::string_view>& inputs) {
-	RootAstNode::Ptr firstRoot = nullptr;
+	const bool caching = !global::cachePath.empty();
+	std::string key;
+	bool upToDate = false;
+	{
+		stats::Timer timer(stats::Phase::Cache);
+		if(caching || global::reproducibleFlag) {
+			key = configurationKey(inputs);
+		}
+		upToDate = caching && cache::upToDate(global::cachePath, key);
+	}
+
+	if(upToDate) {
+		if(global::verboseAllFlag) {
+			std::cout << "Output is up to date with " << global::cachePath << '\n';
+		}
+		return;
+	}
+
 	std::string_view outputFile;
+	auto firstRoot = global::jobs == 1
+		? serialFrontEnd(inputs, outputFile)
+		: parallelFrontEnd(inputs, outputFile);
+	if(!firstRoot) {
+		return;
+	}
+	stats::add(stats::Counter::Nodes, firstRoot->nodes);
+	stats::add(stats::Counter::Structs, firstRoot->structs.size());
+	stats::add(stats::Counter::Traits, firstRoot->traits.size());
+
+	if(global::verboseAllFlag || global::verboseAstFlag) {
+		AstPrinter printer;
+		printer.print(*firstRoot);
+	}
+
+	auto file = getFile(outputFile);
+	auto path = joinPaths(global::outputPath, setStub(file, "hpp"));
+	auto sourcePath = global::splitFlag ? joinPaths(global::outputPath, setStub(file, "cpp")) : std::string();
+
+	std::string stamp = "// File autogenerated by scv ";
+	if(global::reproducibleFlag) {
+		stamp.append(global::version);
+		stamp.append(" from input ");
+		stamp.append(cache::hashSources(key, sources));
+	} else {
+		stamp.append("on: ");
+		stamp.append(getDate());
+	}
+
+	Emitter emitter(*firstRoot, path, sourcePath, stamp);
+	emitter();
+	dieIfError();
+
+	if(caching) {
+		stats::Timer timer(stats::Phase::Cache);
+		std::vector<std::string> outputs = {path};
+		if(!sourcePath.empty()) {
+			outputs.push_back(sourcePath);
+		}
+		cache::store(global::cachePath, key, outputs, sources);
+		dieIfError();
+	}
+}
+
+bool Pipeline::hasProcessed(const std::string_view sv) {
+	return previouslyProcessed.count(sv) > 0;
+}
+
+RootAstNode::Ptr Pipeline::buildRootFromSrc(std::string_view src, const std::string_view origin) {
+	std::vector<Token> tokens;
+	{
+		stats::Timer timer(stats::Phase::Lex);
+		Lexer lexer(src);
+		tokens = lexer();
+		dieIfError();
+		stats::add(stats::Counter::Tokens, tokens.size());
+	}
+
+	RootAstNode::Ptr root;
+	{
+		stats::Timer timer(stats::Phase::Parse);
+		Parser parser(tokens, src, origin);
+		root = parser();
+		dieIfError();
+	}
+
+	// Nodes refer back to their tokens
+	storeTokens(std::move(tokens));
+	return root;
+}
+
+std::string_view Pipeline::readFile(const std::string_view sv) {
+	stats::Timer timer(stats::Phase::Read);
+	previouslyProcessed.emplace(sv);
+	MappedFile src;
+	src.open(std::string(sv).c_str());
+	dieIfError();
+
+	return storeSrc(sv, std::move(src));
+}
+
+RootAstNode::Ptr Pipeline::serialFrontEnd(const std::vector<std::string_view>& inputs, std::string_view& outputFile) {
+	RootAstNode::Ptr firstRoot = nullptr;
 
 	for(const auto sv : inputs) {
 		if(hasProcessed(sv)) {
@@ -24,10 +133,10 @@ void Pipeline::full(const std::vector<std::string_view>& inputs) {
 		if(global::verboseAllFlag) {
 			std::cout << "Processing " << sv << '\n';
 		}
-		auto& src = Pipeline::readFile(sv);
+		auto src = Pipeline::readFile(sv);
 		auto root = Pipeline::buildRootFromSrc(src, sv);
 		if(!root) {
-			return;
+			return nullptr;
 		}
 
 		if(!firstRoot) {
@@ -38,45 +147,166 @@ void Pipeline::full(const std::vector<std::string_view>& inputs) {
 		}
 	}
 
-	if(global::verboseAllFlag || global::verboseAstFlag) {
-		AstPrinter printer;
-		printer.print(*firstRoot);
+	return firstRoot;
+}
+
+// Every file reachable from the inputs is read, lexed and parsed as its own
+// task. Once all tasks are done the units are joined on this thread in the
+// same order the serial front end would have visited them, which also makes
+// the first reported error the same one the serial front end would report
+RootAstNode::Ptr Pipeline::parallelFrontEnd(const std::vector<std::string_view>& inputs, std::string_view& outputFile) {
+	Units units;
+	std::mutex unitsMutex;
+	ThreadPool pool(global::jobs > 0 ? global::jobs : ThreadPool::defaultSize());
+
+	std::function<void(const std::string&)> schedule = [&](const std::string& path) {
+		Unit* unit;
+		{
+			std::lock_guard lock(unitsMutex);
+			auto [it, inserted] = units.try_emplace(path);
+			if(!inserted) {
+				return;
+			}
+			it->second = std::make_unique<Unit>();
+			unit = it->second.get();
+		}
+
+		pool.submit([&, unit, path]() {
+			buildUnit(*unit, path);
+			for(const auto& req : unit->requires) {
+				schedule(req.path);
+			}
+		});
+	};
+
+	for(const auto sv : inputs) {
+		schedule(std::string(sv));
 	}
+	pool.wait();
 
-	auto file = getFile(outputFile);
-	file = setStub(file, "hpp");
-	auto path = joinPaths(global::outputPath, file);
+	stats::Timer timer(stats::Phase::Requires);
+	RootAstNode::Ptr firstRoot = nullptr;
+	for(const auto sv : inputs) {
+		if(hasProcessed(sv)) {
+			continue;
+		}
 
-	Emitter emitter(*firstRoot, path);
-	emitter();
-	dieIfError();
+		if(global::verboseAllFlag) {
+			std::cout << "Processing " << sv << '\n';
+		}
+		previouslyProcessed.emplace(sv);
+		auto root = mergeUnit(*units.find(std::string(sv))->second, units);
+
+		if(!firstRoot) {
+			firstRoot = std::move(root);
+			outputFile = sv;
+		} else {
+			firstRoot->join(root);
+		}
+	}
+
+	return firstRoot;
 }
 
-bool Pipeline::hasProcessed(const std::string_view sv) {
-	return previouslyProcessed.count(sv) > 0;
+void Pipeline::buildUnit(Unit& unit, const std::string& path) {
+	error::clear();
+
+	std::string_view stored;
+	{
+		stats::Timer timer(stats::Phase::Read);
+		MappedFile src;
+		if(!src.open(path.c_str())) {
+			unit.error = error::get();
+			return;
+		}
+		stored = storeSrc(path, std::move(src));
+	}
+
+	{
+		stats::Timer timer(stats::Phase::Lex);
+		Lexer lexer(stored);
+		unit.tokens = lexer();
+		if(!error::empty()) {
+			unit.error = error::get();
+			return;
+		}
+		stats::add(stats::Counter::Tokens, unit.tokens.size());
+	}
+
+	stats::Timer timer(stats::Phase::Parse);
+	Parser parser(unit.tokens, stored, path, &unit.requires);
+	unit.root = parser();
+	if(!error::empty()) {
+		unit.error = error::get();
+	}
 }
 
-RootAstNode::Ptr Pipeline::buildRootFromSrc(const std::string& src, const std::string_view origin) {
-	Lexer lexer(src);
-	auto tokens = lexer();
-	dieIfError();
+// Rebuilds the root the serial front end would have produced for this unit,
+// joining each required unit in where its directive appeared
+RootAstNode::Ptr Pipeline::mergeUnit(Unit& unit, Units& units) {
+	auto parsed = std::move(unit.root);
+	auto root = std::make_unique<RootAstNode>();
+	size_t nStructs = 0;
+	size_t nTraits = 0;
+	size_t nChildren = 0;
 
-	Parser parser(tokens, src, origin);
-	auto root = parser();
-	dieIfError();
+	auto spliceUntil = [&](size_t toStructs, size_t toTraits, size_t toChildren) {
+		if(!parsed) {
+			return;
+		}
+		root->structs.insert(root->structs.end(), parsed->structs.begin() + nStructs, parsed->structs.begin() + toStructs);
+		root->traits.insert(root->traits.end(), parsed->traits.begin() + nTraits, parsed->traits.begin() + toTraits);
+		root->children.insert(root->children.end(), parsed->children.begin() + nChildren, parsed->children.begin() + toChildren);
+		nStructs = toStructs;
+		nTraits = toTraits;
+		nChildren = toChildren;
+	};
 
+	for(const auto& req : unit.requires) {
+		spliceUntil(req.nStructs, req.nTraits, req.nChildren);
+		if(hasProcessed(req.path)) {
+			continue;
+		}
+		previouslyProcessed.emplace(req.path);
+		auto otherRoot = mergeUnit(*units.find(req.path)->second, units);
+		root->join(otherRoot);
+	}
+
+	if(!unit.error.empty()) {
+		error::set(unit.error);
+		dieIfError();
+	}
+
+	spliceUntil(parsed->structs.size(), parsed->traits.size(), parsed->children.size());
+	root->arena.absorb(parsed->arena);
+	root->nodes += parsed->nodes;
+	storeTokens(std::move(unit.tokens));
 	return root;
 }
 
-const std::string& Pipeline::readFile(const std::string_view sv) {
-	previouslyProcessed.emplace(sv);
-	auto src = consume(sv.data());
-	dieIfError();
+// Everything affecting the output apart from the contents of the files read
+std::string Pipeline::configurationKey(const std::vector<std::string_view>& inputs) {
+	Hasher hasher;
+	hasher.update(global::fingerprint());
+	for(const auto sv : inputs) {
+		hasher.update(sv.size());
+		hasher.update(sv);
+	}
+	return hasher.hex();
+}
 
-	// This is most likely not a malicious move as source files
-	// generally are more than 16-32 bytes in size, meaning that
-	// the drawbacks of SSO do not need to be accounted for
+// Sources stay mapped until exit, as tokens and nodes are views into them
+std::string_view Pipeline::storeSrc(const std::string_view path, MappedFile&& src) {
+	std::lock_guard lock(storageMutex);
 	storedSrcs.push_back(std::move(src));
+	auto view = storedSrcs.back().view();
+	sources.emplace(path, view);
+	registerSource(view);
+	stats::add(stats::Counter::Files, 1);
+	return view;
+}
 
-	return storedSrcs.back();
+void Pipeline::storeTokens(std::vector<Token>&& tokens) {
+	std::lock_guard lock(storageMutex);
+	storedTokens.push_back(std::move(tokens));
 }
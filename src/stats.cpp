@@ -0,0 +1,173 @@
+#include "stats.hpp"
+
+#include "error.hpp"
+#include "global.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Output {
+	std::string path;
+	size_t bytes;
+	bool changed;
+};
+
+bool isEnabled = false;
+stats::Timer::Clock::time_point enabledAt;
+std::array<std::atomic<uint64_t>, static_cast<size_t>(stats::Phase::N_Phases)> nanoseconds{};
+std::array<std::atomic<uint64_t>, static_cast<size_t>(stats::Counter::N_Counters)> counters{};
+std::vector<Output> outputs;
+std::mutex outputsMutex;
+thread_local stats::Timer* innermost = nullptr;
+
+uint64_t elapsed(stats::Timer::Clock::time_point from, stats::Timer::Clock::time_point to) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+double seconds(stats::Phase phase) {
+	return nanoseconds[static_cast<size_t>(phase)].load() / 1e9;
+}
+
+uint64_t count(stats::Counter counter) {
+	return counters[static_cast<size_t>(counter)].load();
+}
+
+double totalSeconds() {
+	return elapsed(enabledAt, stats::Timer::Clock::now()) / 1e9;
+}
+
+std::string escapeJson(std::string_view sv) {
+	std::string str;
+	for(const char c : sv) {
+		if(c == '"' || c == '\\') {
+			str.push_back('\\');
+			str.push_back(c);
+		} else if(static_cast<unsigned char>(c) < 0x20) {
+			char buffer[8];
+			std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+			str.append(buffer);
+		} else {
+			str.push_back(c);
+		}
+	}
+	return str;
+}
+
+}
+
+namespace stats {
+
+void enable() {
+	isEnabled = true;
+	enabledAt = Timer::Clock::now();
+}
+
+bool enabled() {
+	return isEnabled;
+}
+
+void add(Counter counter, size_t n) {
+	if(isEnabled) {
+		counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+	}
+}
+
+void addOutput(const std::string& path, size_t bytes, bool changed) {
+	if(isEnabled) {
+		std::lock_guard lock(outputsMutex);
+		outputs.push_back({path, bytes, changed});
+	}
+}
+
+Timer::Timer(Phase phase) : phase(phase), parent(nullptr) {
+	if(!isEnabled) {
+		return;
+	}
+	start = Clock::now();
+	parent = innermost;
+	if(parent) {
+		nanoseconds[static_cast<size_t>(parent->phase)] += elapsed(parent->start, start);
+	}
+	innermost = this;
+}
+
+Timer::~Timer() {
+	if(!isEnabled || innermost != this) {
+		return;
+	}
+	const auto now = Clock::now();
+	nanoseconds[static_cast<size_t>(phase)] += elapsed(start, now);
+	innermost = parent;
+	if(parent) {
+		parent->start = now;
+	}
+}
+
+void print(std::ostream& os) {
+	const auto flags = os.flags();
+	os << std::fixed << std::setprecision(3);
+	os << "Phase         ms\n";
+	for(size_t i = 0; i < phaseNames.size(); i++) {
+		os << std::left << std::setw(10) << phaseNames[i]
+			<< std::right << std::setw(10) << seconds(static_cast<Phase>(i)) * 1e3 << '\n';
+	}
+	os << std::left << std::setw(10) << "total"
+		<< std::right << std::setw(10) << totalSeconds() * 1e3 << '\n';
+
+	os << "\nCounter\n";
+	for(size_t i = 0; i < counterNames.size(); i++) {
+		os << std::left << std::setw(16) << counterNames[i]
+			<< std::right << count(static_cast<Counter>(i)) << '\n';
+	}
+
+	std::lock_guard lock(outputsMutex);
+	for(const auto& output : outputs) {
+		os << "\nWrote " << output.bytes << " bytes to " << output.path
+			<< (output.changed ? "\n" : " (unchanged)\n");
+	}
+	os.flags(flags);
+}
+
+bool writeJson(const std::string& path) {
+	std::ofstream file(path);
+	if(!file) {
+		error::set("Could not open file: " + path + '\n');
+		return false;
+	}
+
+	file << "{\n\t\"version\": \"" << global::version << "\",\n";
+	file << "\t\"jobs\": " << global::jobs << ",\n";
+	file << "\t\"totalSeconds\": " << totalSeconds() << ",\n";
+	file << "\t\"phases\": {";
+	for(size_t i = 0; i < phaseNames.size(); i++) {
+		file << (i ? ",\n" : "\n") << "\t\t\"" << phaseNames[i] << "\": " << seconds(static_cast<Phase>(i));
+	}
+	file << "\n\t},\n\t\"counters\": {";
+	for(size_t i = 0; i < counterNames.size(); i++) {
+		file << (i ? ",\n" : "\n") << "\t\t\"" << counterNames[i] << "\": " << count(static_cast<Counter>(i));
+	}
+	file << "\n\t},\n\t\"outputs\": [";
+
+	std::lock_guard lock(outputsMutex);
+	for(size_t i = 0; i < outputs.size(); i++) {
+		file << (i ? ",\n" : "\n") << "\t\t{\"path\": \"" << escapeJson(outputs[i].path)
+			<< "\", \"bytes\": " << outputs[i].bytes
+			<< ", \"changed\": " << (outputs[i].changed ? "true" : "false") << '}';
+	}
+	file << "\n\t]\n}\n";
+
+	if(!file) {
+		error::set("Could not write file: " + path + '\n');
+		return false;
+	}
+	return true;
+}
+
+}
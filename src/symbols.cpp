@@ -0,0 +1,505 @@
+#include "symbols.hpp"
+
+#include "builtin.hpp"
+#include "error.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+
+SymbolTable::SymbolTable() {
+	struct Primitive {
+		std::string_view name;
+		std::string_view spelling;
+		Kind kind;
+		uint32_t size;
+	};
+
+	constexpr Primitive primitives[] = {
+		{"int",    "int",         Kind::Signed,   4},
+		{"i8",     "int8_t",      Kind::Signed,   1},
+		{"i16",    "int16_t",     Kind::Signed,   2},
+		{"i32",    "int32_t",     Kind::Signed,   4},
+		{"i64",    "int64_t",     Kind::Signed,   8},
+		{"u8",     "uint8_t",     Kind::Unsigned, 1},
+		{"u16",    "uint16_t",    Kind::Unsigned, 2},
+		{"u32",    "uint32_t",    Kind::Unsigned, 4},
+		{"u64",    "uint64_t",    Kind::Unsigned, 8},
+		{"byte",   "uint8_t",     Kind::Unsigned, 1},
+		{"bool",   "bool",        Kind::Bool,     1},
+		{"float",  "float",       Kind::Float,    4},
+		{"double", "double",      Kind::Float,    8},
+		{"f32",    "float",       Kind::Float,    4},
+		{"f64",    "double",      Kind::Float,    8},
+		{"string", "std::string", Kind::String,   0},
+	};
+
+	for(const auto& primitive : primitives) {
+		addType(primitive.name, primitive.spelling, none, primitive.kind, primitive.size);
+	}
+
+	if(global::pmrFlag) {
+		types[findType("string")].spelling = "std::pmr::string";
+		allocator = "std::pmr::polymorphic_allocator<std::byte>";
+		requirements.insert("<cstddef>");
+		requirements.insert("<memory_resource>");
+		requirements.insert("<utility>");
+	} else {
+		allocator = "std::allocator<std::byte>";
+	}
+
+	if(global::reflectFlag) {
+		requirements.insert("<array>");
+		requirements.insert("<cstddef>");
+		requirements.insert("<string_view>");
+		requirements.insert("<type_traits>");
+		requirements.insert("<vector>");
+	}
+}
+
+// Fixed width types are trivially copyable, and all but inline strings are
+// aligned to their size
+bool SymbolTable::Type::fixedWidth() const {
+	return size > 0;
+}
+
+bool SymbolTable::build(const RootAstNode& root) {
+	return mapTypes(root)
+		&& mapMembers()
+		&& mapTraits(root)
+		&& checkBuiltins()
+		&& orderStructs()
+		&& layoutStructs();
+}
+
+SymbolTable::Id SymbolTable::findType(std::string_view name) const {
+	auto it = typeIds.find(name);
+	return it != typeIds.end() ? it->second : none;
+}
+
+SymbolTable::Id SymbolTable::findStruct(std::string_view name) const {
+	auto id = findType(name);
+	return id != none ? types[id].structId : none;
+}
+
+SymbolTable::Id SymbolTable::findTrait(std::string_view name) const {
+	auto it = traitIds.find(name);
+	return it != traitIds.end() ? it->second : none;
+}
+
+// Member at a position of the struct's layout
+const SymbolTable::Member& SymbolTable::memberAt(const Struct& struc, size_t position) const {
+	return struc.members[struc.layout[position]];
+}
+
+bool SymbolTable::implements(Id structId, Id trait) const {
+	const auto& traits = structs[structId].traits;
+	return std::find(traits.begin(), traits.end(), trait) != traits.end();
+}
+
+bool SymbolTable::mapTypes(const RootAstNode& root) {
+	constexpr std::string_view structOptions[] = {
+		"compact",
+		"varint",
+		"cachedhash",
+	};
+
+	structs.reserve(root.structs.size());
+	typeIds.reserve(typeIds.size() + root.structs.size());
+	for(const auto node : root.structs) {
+		if(findType(node->name) != none) {
+			error::onToken("Type '" + std::string(node->name) + "' already defined", *node->origin);
+			return false;
+		}
+		for(const auto option : node->options) {
+			if(std::find(std::begin(structOptions), std::end(structOptions), option) == std::end(structOptions)) {
+				error::onToken("Unknown struct option '" + std::string(option) + "'", *node->origin);
+				return false;
+			}
+		}
+		auto hasOption = [&](std::string_view option) {
+			return std::find(node->options.begin(), node->options.end(), option) != node->options.end();
+		};
+		const Id id = structs.size();
+		const Id type = addType(node->name, node->name, id, Kind::Struct, 0);
+		structs.push_back(Struct{node, type, {}, {}, {}, {}, 1, global::compactFlag || hasOption("compact"), hasOption("varint"), false, hasOption("cachedhash")});
+	}
+	return true;
+}
+
+bool SymbolTable::mapMembers() {
+	size_t nMembers = 0;
+	for(const auto& struc : structs) {
+		nMembers += struc.node->children.size();
+	}
+	members.reserve(nMembers);
+	dependencies.reserve(nMembers);
+
+	std::vector<std::pair<size_t, size_t>> memberRanges;
+	std::vector<std::pair<size_t, size_t>> dependencyRanges;
+	memberRanges.reserve(structs.size());
+	dependencyRanges.reserve(structs.size());
+
+	for(const auto& struc : structs) {
+		const size_t firstMember = members.size();
+		const size_t firstDependency = dependencies.size();
+		for(const auto child : struc.node->children) {
+			const auto node = static_cast<const MemberAstNode*>(child);
+			auto type = node->capacity > 0 ? mapInlineString(node) : findType(node->type);
+			if(type == none) {
+				if(node->capacity == 0) {
+					error::onToken("Type '" + std::string(node->type) + "' not defined", *node->origin);
+				}
+				return false;
+			}
+			if(node->count > 0 || node->sequence) {
+				type = mapContainer(node, type);
+				if(type == none) {
+					return false;
+				}
+			}
+			if(findType(node->name) != none) {
+				error::onToken("Cannot name a member '" + std::string(node->name) + "'", *node->nameToken);
+				return false;
+			}
+			if(!checkTag(node, firstMember)) {
+				return false;
+			}
+			Encoding encoding;
+			if(!mapEncoding(struc, node, type, encoding)) {
+				return false;
+			}
+			members.push_back(Member{node, type, encoding});
+			if(const auto held = heldStruct(type); held != none) {
+				dependencies.push_back(held);
+			}
+		}
+		memberRanges.emplace_back(firstMember, members.size() - firstMember);
+		dependencyRanges.emplace_back(firstDependency, dependencies.size() - firstDependency);
+	}
+
+	// Spans are only taken once the vectors are done growing
+	for(size_t i = 0; i < structs.size(); i++) {
+		structs[i].members = Span<const Member>(members.data() + memberRanges[i].first, memberRanges[i].second);
+		structs[i].dependencies = Span<const Id>(dependencies.data() + dependencyRanges[i].first, dependencyRanges[i].second);
+	}
+	return true;
+}
+
+// Inline strings are added as types the first time a capacity is used
+SymbolTable::Id SymbolTable::mapInlineString(const MemberAstNode* node) {
+	constexpr uint32_t maxCapacity = 255;
+	if(node->type != "string") {
+		error::onToken("Only strings take a capacity, not '" + std::string(node->type) + "'", *node->origin);
+		return none;
+	}
+	if(node->capacity > maxCapacity) {
+		error::onToken("Strings hold at most " + std::to_string(maxCapacity) + " bytes inline", *node->origin);
+		return none;
+	}
+
+	const auto capacity = std::to_string(node->capacity);
+	const auto name = "string<" + capacity + ">";
+	if(const auto id = findType(name); id != none) {
+		return id;
+	}
+	if(!inlineStrings) {
+		inlineStrings = true;
+		requirements.insert("<cstddef>");
+		requirements.insert("<cstdint>");
+		requirements.insert("<cstring>");
+		requirements.insert("<string_view>");
+	}
+	return addType(names.copy(name), names.copy("scv::InlineString<" + capacity + ">"), none, Kind::InlineString, node->capacity + 1);
+}
+
+// Arrays and sequences are added as types the first time they are used.
+// Sequences are spelled as vectors, which hold bools as bits and so could
+// not hand out their elements as a block
+SymbolTable::Id SymbolTable::mapContainer(const MemberAstNode* node, Id element) {
+	const auto& type = types[element];
+	std::string name;
+	std::string spelling;
+	if(node->sequence) {
+		if(type.kind == Kind::Bool) {
+			error::onToken("Sequences cannot hold bools, which std::vector packs into bits", *node->origin);
+			return none;
+		}
+		name = "[" + std::string(type.name) + "]";
+		spelling = (global::pmrFlag ? "std::pmr::vector<" : "std::vector<") + std::string(type.spelling) + ">";
+	} else {
+		const uint64_t size = uint64_t(node->count) * type.size;
+		if(size > std::numeric_limits<uint32_t>::max()) {
+			error::onToken("Array of " + std::to_string(size) + " bytes is too large", *node->origin);
+			return none;
+		}
+		name = std::string(type.name) + "[" + std::to_string(node->count) + "]";
+		spelling = "std::array<" + std::string(type.spelling) + ", " + std::to_string(node->count) + ">";
+	}
+
+	if(const auto id = findType(name); id != none) {
+		return id;
+	}
+	requirements.insert(node->sequence ? "<vector>" : "<array>");
+	const auto kind = node->sequence ? Kind::Sequence : Kind::Array;
+	const uint32_t size = node->sequence ? 0 : node->count * type.size;
+	const Id id = addType(names.copy(name), names.copy(spelling), none, kind, size);
+	types[id].element = element;
+	types[id].count = node->count;
+	return id;
+}
+
+// Tags fit in 29 bits, so that a tag along with its wire type fits in 32
+bool SymbolTable::checkTag(const MemberAstNode* node, size_t firstMember) const {
+	constexpr uint32_t maxTag = (uint32_t(1) << 29) - 1;
+	if(node->tag > maxTag) {
+		error::onToken("Tags must lie between 1 and " + std::to_string(maxTag), *node->nameToken);
+		return false;
+	}
+	for(size_t i = firstMember; node->tag > 0 && i < members.size(); i++) {
+		if(members[i].node->tag == node->tag) {
+			error::onToken("Tag " + std::to_string(node->tag) + " is already used by '" + std::string(members[i].node->name) + "'", *node->nameToken);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Integers of varint structs are varints, with signed ones zigzag encoded,
+// unless their members say otherwise
+bool SymbolTable::mapEncoding(const Struct& struc, const MemberAstNode* node, Id type, Encoding& encoding) const {
+	const auto kind = types[type].kind;
+	const bool integer = kind == Kind::Signed || kind == Kind::Unsigned;
+	encoding = Encoding::Fixed;
+	if(struc.varint && integer) {
+		encoding = kind == Kind::Signed ? Encoding::Zigzag : Encoding::Varint;
+	}
+
+	for(const auto option : node->options) {
+		if(option == "fixed") {
+			encoding = Encoding::Fixed;
+		} else if(option == "varint") {
+			encoding = Encoding::Varint;
+		} else if(option == "zigzag") {
+			encoding = Encoding::Zigzag;
+		} else {
+			error::onToken("Unknown member option '" + std::string(option) + "'", *node->nameToken);
+			return false;
+		}
+
+		if(!integer) {
+			error::onToken("Only integers can be encoded as '" + std::string(option) + "'", *node->nameToken);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SymbolTable::mapTraits(const RootAstNode& root) {
+	traits.reserve(root.traits.size());
+	traitIds.reserve(root.traits.size());
+	requirements.reserve(root.traits.size());
+	for(const auto node : root.traits) {
+		auto res = traitIds.try_emplace(node->name, traits.size());
+		if(!res.second) {
+			error::onToken("Duplicate trait encountered", *node->origin);
+			return false;
+		}
+		bool inlined = false;
+		for(const auto option : node->options) {
+			if(option != "inline") {
+				error::onToken("Unknown trait option '" + std::string(option) + "'", *node->origin);
+				return false;
+			}
+			inlined = true;
+		}
+		traits.push_back(Trait{node, nullptr, inlined});
+	}
+
+	size_t nTraits = 0;
+	for(const auto& struc : structs) {
+		nTraits += struc.node->traits.size();
+	}
+	structTraits.reserve(nTraits);
+
+	for(auto& struc : structs) {
+		const size_t first = structTraits.size();
+		for(const auto name : struc.node->traits) {
+			auto trait = findTrait(name);
+			if(trait == none) {
+				trait = addBuiltin(name);
+			}
+			if(trait == none) {
+				error::onToken("Trait '" + std::string(name) + "' requested is never defined", *struc.node->origin);
+				return false;
+			}
+			structTraits.push_back(trait);
+		}
+		struc.traits = Span<const Id>(structTraits.data() + first, structTraits.size() - first);
+	}
+	return true;
+}
+
+// Traits defined in specs take precedence over builtins of the same name,
+// which are only added once a struct asks for them
+SymbolTable::Id SymbolTable::addBuiltin(std::string_view name) {
+	const auto builtin = findBuiltin(name);
+	if(!builtin) {
+		return none;
+	}
+	const Id id = traits.size();
+	traits.push_back(Trait{nullptr, builtin, false});
+	traitIds.emplace(builtin->name(), id);
+	return id;
+}
+
+// Gathers what every trait in use requires, once builtins have checked
+// that they can be implemented for the structs using them
+bool SymbolTable::checkBuiltins() {
+	const Id hashable = findTrait("Hashable");
+	for(const auto& struc : structs) {
+		if(struc.cachedHash && (hashable == none || !traits[hashable].builtin || !implements(types[struc.type].structId, hashable))) {
+			error::onToken("Struct option 'cachedhash' requires the builtin trait Hashable", *struc.node->origin);
+			return false;
+		}
+		for(const auto trait : struc.traits) {
+			if(!traits[trait].builtin) {
+				for(const auto req : traits[trait].node->requirements) {
+					requirements.insert(req);
+				}
+			} else if(!traits[trait].builtin->check(*this, struc)) {
+				return false;
+			} else {
+				for(const auto req : traits[trait].builtin->requirements()) {
+					requirements.insert(req);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Depth first, dependencies before dependents, with ties broken by
+// declaration order. Iterative so that long dependency chains cannot
+// exhaust the stack
+bool SymbolTable::orderStructs() {
+	enum Mark : uint8_t {
+		Unvisited,
+		Visiting,
+		Done,
+	};
+	std::vector<Mark> marks(structs.size(), Unvisited);
+	std::vector<std::pair<Id, size_t>> stack;
+	order.reserve(structs.size());
+
+	for(Id root = 0; root < structs.size(); root++) {
+		if(marks[root] != Unvisited) {
+			continue;
+		}
+		marks[root] = Visiting;
+		stack.emplace_back(root, 0);
+
+		while(!stack.empty()) {
+			auto& [id, next] = stack.back();
+			const auto& deps = structs[id].dependencies;
+			if(next == deps.size()) {
+				marks[id] = Done;
+				order.push_back(id);
+				stack.pop_back();
+				continue;
+			}
+
+			const Id dep = deps[next++];
+			if(marks[dep] == Visiting) {
+				error::onToken("Cyclic dependency detected inside struct", *structs[id].node->origin);
+				return false;
+			}
+			if(marks[dep] == Unvisited) {
+				marks[dep] = Visiting;
+				stack.emplace_back(dep, 0);
+			}
+		}
+	}
+	return true;
+}
+
+// Structs are laid out after the structs they hold, so that their alignment
+// and whether they take an allocator is known. Reordering by decreasing
+// alignment leaves no padding between members, as every size is a multiple
+// of the alignment of its type
+bool SymbolTable::layoutStructs() {
+	layouts.reserve(members.size());
+	std::vector<size_t> firsts(structs.size());
+	for(const auto id : order) {
+		auto& struc = structs[id];
+		firsts[id] = layouts.size();
+		for(uint32_t i = 0; i < struc.members.size(); i++) {
+			const auto& type = types[struc.members[i].type];
+			if(type.kind == Kind::Array && allocates(type.element)) {
+				error::onToken("Arrays cannot pass an allocator on to their elements, so '" + std::string(struc.members[i].node->name)
+					+ "' must be a sequence", *struc.members[i].node->nameToken);
+				return false;
+			}
+			layouts.push_back(i);
+			struc.alignment = std::max(struc.alignment, alignmentOf(struc.members[i].type));
+			struc.allocatorAware = struc.allocatorAware || allocates(struc.members[i].type);
+		}
+		if(struc.compact) {
+			std::stable_sort(layouts.begin() + firsts[id], layouts.end(), [&](uint32_t lhs, uint32_t rhs) {
+				return alignmentOf(struc.members[lhs].type) > alignmentOf(struc.members[rhs].type);
+			});
+		}
+	}
+
+	for(size_t i = 0; i < structs.size(); i++) {
+		structs[i].layout = Span<const uint32_t>(layouts.data() + firsts[i], structs[i].members.size());
+	}
+	return true;
+}
+
+// Strings and sequences are assumed to be aligned as pointers on 64 bit
+// platforms, which the layout checks written for compact structs verify
+uint32_t SymbolTable::alignmentOf(Id type) const {
+	constexpr uint32_t pointerAlignment = 8;
+	const auto& t = types[type];
+	switch(t.kind) {
+		case Kind::String:
+		case Kind::Sequence:
+			return pointerAlignment;
+		case Kind::InlineString:
+			return 1;
+		case Kind::Array:
+			return alignmentOf(t.element);
+		case Kind::Struct:
+			return structs[t.structId].alignment;
+		default:
+			return t.size;
+	}
+}
+
+SymbolTable::Id SymbolTable::heldStruct(Id type) const {
+	const auto& t = types[type];
+	return t.element != none ? types[t.element].structId : t.structId;
+}
+
+bool SymbolTable::allocates(Id type) const {
+	const auto& t = types[type];
+	switch(t.kind) {
+		case Kind::String:
+		case Kind::Sequence:
+			return global::pmrFlag;
+		case Kind::Struct:
+			return structs[t.structId].allocatorAware;
+		default:
+			return false;
+	}
+}
+
+SymbolTable::Id SymbolTable::addType(std::string_view name, std::string_view spelling, Id structId, Kind kind, uint32_t size) {
+	const Id id = types.size();
+	types.push_back(Type{name, spelling, structId, kind, size});
+	typeIds.emplace(name, id);
+	return id;
+}
@@ -0,0 +1,70 @@
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(size_t nWorkers) {
+	if(nWorkers < 1) {
+		nWorkers = 1;
+	}
+	workers.reserve(nWorkers);
+	for(size_t i = 0; i < nWorkers; i++) {
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for(auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::submit(Task task) {
+	{
+		std::lock_guard lock(mutex);
+		tasks.push(std::move(task));
+	}
+	available.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock lock(mutex);
+	idle.wait(lock, [this]() {
+		return tasks.empty() && active == 0;
+	});
+}
+
+size_t ThreadPool::defaultSize() {
+	auto n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+void ThreadPool::work() {
+	while(1) {
+		Task task;
+		{
+			std::unique_lock lock(mutex);
+			available.wait(lock, [this]() {
+				return stopping || !tasks.empty();
+			});
+			if(tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop();
+			++active;
+		}
+
+		task();
+
+		{
+			std::lock_guard lock(mutex);
+			--active;
+			if(tasks.empty() && active == 0) {
+				idle.notify_all();
+			}
+		}
+	}
+}
@@ -1,5 +1,42 @@
 #include "token.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+std::vector<std::string_view> sources;
+std::mutex sourcesMutex;
+
+}
+
 std::string_view Token::str() const {
-	return !value.empty() ? value : tokenStrings[static_cast<size_t>(type)];
+	return std::string_view(begin, length);
+}
+
+Location locate(std::string_view src, size_t index) {
+	auto first = src.begin();
+	auto last = first + index;
+	auto row = std::count(first, last, '\n') + 1;
+	auto lineStart = std::find(std::make_reverse_iterator(last), std::make_reverse_iterator(first), '\n').base();
+	return Location{
+		static_cast<uint32_t>(row),
+		static_cast<uint32_t>(last - lineStart + 1),
+	};
+}
+
+void registerSource(std::string_view src) {
+	std::lock_guard lock(sourcesMutex);
+	sources.push_back(src);
+}
+
+Location locate(const Token& token) {
+	std::lock_guard lock(sourcesMutex);
+	for(const auto src : sources) {
+		if(token.begin >= src.data() && token.begin <= src.data() + src.size()) {
+			return locate(src, token.begin - src.data());
+		}
+	}
+	return Location{0, 0};
 }
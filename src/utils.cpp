@@ -17,15 +17,17 @@ std::string consume(const char* path) {
 	if(size < 1) {
 		return std::string();
 	}
-	std::vector<char> bytes(size);
+	std::string bytes(size, '\0');
 	file.read(bytes.data(), size);
-	return std::string(bytes.data(), size);
+	return bytes;
 }
 
 void dumpTokens(const std::vector<Token>& tokens) {
 	for(auto& t : tokens) {
 		size_t index = static_cast<size_t>(t.type);
-		std::cout << t.row << ":" << t.column << ": type: "<< tokenStrings[index] << " value: " << t.value << '\n';
+		auto location = locate(t);
+		auto value = t.type == TokenType::Identifier || t.type == TokenType::Symbol || t.type == TokenType::Number ? t.str() : std::string_view();
+		std::cout << location.row << ":" << location.column << ": type: "<< tokenStrings[index] << " value: " << value << '\n';
 	}
 }
 
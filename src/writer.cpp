@@ -0,0 +1,134 @@
+#include "writer.hpp"
+
+#include "error.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr std::string_view whitespace = " \t\n\v\f\r";
+
+}
+
+OutputWriter::~OutputWriter() {
+	if(temp.is_open()) {
+		temp.close();
+		std::remove(tempPath.c_str());
+	}
+}
+
+bool OutputWriter::open(const std::string& path, size_t sizeHint) {
+	this->path = path;
+	tempPath = path + ".tmp";
+	written = 0;
+	failed = false;
+	buffer.clear();
+	buffer.reserve(std::min(sizeHint, chunkSize) + chunkSize / 4);
+
+	existing.open(path, std::ios::in | std::ios::binary);
+	identical = existing.is_open();
+	if(!identical) {
+		diverge();
+	}
+	return !failed;
+}
+
+bool OutputWriter::close() {
+	auto end = buffer.find_last_not_of(whitespace);
+	buffer.resize(end == std::string::npos ? 0 : end + 1);
+	commit(buffer.data(), buffer.size());
+	buffer.clear();
+
+	// Same prefix, but the existing file may still be longer
+	if(identical && existing.peek() != std::ifstream::traits_type::eof()) {
+		diverge();
+	}
+
+	if(failed) {
+		return false;
+	}
+
+	if(identical) {
+		existing.close();
+		return true;
+	}
+
+	temp.close();
+	if(std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		// Renaming over an existing file is not allowed everywhere
+		std::remove(path.c_str());
+		if(std::rename(tempPath.c_str(), path.c_str()) != 0) {
+			std::remove(tempPath.c_str());
+			error::set("Cannot open file '" + path + "'\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t OutputWriter::size() const {
+	return written + buffer.size();
+}
+
+bool OutputWriter::changed() const {
+	return !identical;
+}
+
+// Trailing whitespace is held back, as it is dropped if nothing follows it
+void OutputWriter::flush() {
+	auto end = buffer.find_last_not_of(whitespace);
+	if(end == std::string::npos) {
+		return;
+	}
+	commit(buffer.data(), end + 1);
+	buffer.erase(0, end + 1);
+}
+
+void OutputWriter::commit(const char* data, size_t n) {
+	if(failed || n == 0) {
+		return;
+	}
+
+	if(identical) {
+		scratch.resize(n);
+		existing.read(scratch.data(), n);
+		if(static_cast<size_t>(existing.gcount()) == n && std::memcmp(scratch.data(), data, n) == 0) {
+			written += n;
+			return;
+		}
+		diverge();
+		if(failed) {
+			return;
+		}
+	}
+
+	temp.write(data, n);
+	written += n;
+}
+
+// Everything written so far matched the existing file, so that is where
+// the temporary file takes its first bytes from
+void OutputWriter::diverge() {
+	identical = false;
+	temp.open(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!temp.is_open()) {
+		error::set("Cannot open file '" + tempPath + "'\n");
+		failed = true;
+		return;
+	}
+
+	if(written > 0) {
+		existing.clear();
+		existing.seekg(0, std::ios::beg);
+		scratch.resize(std::min(written, chunkSize));
+		for(size_t left = written; left > 0;) {
+			const size_t n = std::min(left, scratch.size());
+			existing.read(scratch.data(), n);
+			temp.write(scratch.data(), n);
+			left -= n;
+		}
+	}
+	existing.close();
+}
@@ -0,0 +1,42 @@
+#include "tagged.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+// Integers are varints by default, with signed ones zigzag encoded, and
+// members given fixed are written as they lie in memory
+int main() {
+	Order order{};
+	order.id = 300;
+	order.delta = -2;
+	order.flags = 0x81;
+	order.count = 5;
+
+	const unsigned char expected[] = {
+		0x08, 0xac, 0x02,
+		0x10, 0x03,
+		0x19, 0x81,
+		0x20, 0x05,
+	};
+
+	std::byte out[64];
+	const auto end = writeTagged(order, out);
+	const auto size = static_cast<size_t>(end - out);
+	if(taggedSize(order) != size || size != std::size(expected) || std::memcmp(out, expected, size) != 0) {
+		std::printf("Unexpected wire bytes:");
+		for(size_t i = 0; i < size; i++) {
+			std::printf(" %02x", static_cast<unsigned>(out[i]));
+		}
+		std::printf("\n");
+		return 1;
+	}
+
+	Order read{};
+	if(readTagged(read, out, end) != end || read.id != order.id || read.delta != order.delta
+		|| read.flags != order.flags || read.count != order.count) {
+		std::printf("Read back a different order\n");
+		return 1;
+	}
+	return 0;
+}